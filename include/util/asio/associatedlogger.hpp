@@ -12,8 +12,9 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/async_result.hpp>
 
-#include <utility>
 #include <functional>
+#include <type_traits>
+#include <utility>
 
 namespace util { namespace asio {
 
@@ -136,6 +137,75 @@ private:
     std::shared_ptr<log::Logger> mLog;
 };
 
+template <class CompletionToken>
+class LoggerRefCompletionToken {
+    // Like LoggerCompletionToken, but attaches a raw pointer to a `util::log::Logger` instead of a
+    // copy. Handlers created from this token refer to the same logger, so attaching it costs a
+    // pointer copy rather than a logger copy and a heap allocation.
+    //
+    // The logger MUST outlive every handler created from this token, i.e., it must outlive the
+    // asynchronous operation.
+
+public:
+    template <class CT>
+    LoggerRefCompletionToken (CT&& token, log::Logger& lg)
+        : mToken(std::forward<CT>(token))
+        , mLog(&lg)
+    {}
+
+    log::Logger& log () const { return *mLog; }
+    CompletionToken original () const { return mToken; }
+
+private:
+    CompletionToken mToken;
+    log::Logger* mLog;
+};
+
+template <class CompletionToken, class Signature>
+class LoggerRefHandler {
+public:
+    using WrappedHandlerType
+        = typename boost::asio::handler_type<CompletionToken, Signature>::type;
+
+    LoggerRefHandler (LoggerRefCompletionToken<CompletionToken> token)
+        : mHandler(token.original())
+        , mLog(&token.log())
+    {}
+
+    template <class... Params>
+    void operator() (Params&&... ps) {
+        mHandler(std::forward<Params>(ps)...);
+    }
+
+    log::Logger& log () const { return *mLog; }
+    WrappedHandlerType& original () { return mHandler; }
+
+    friend void* asio_handler_allocate (size_t size, LoggerRefHandler* self) {
+        return handler_hooks::allocate(size, self->original());
+    }
+
+    friend void asio_handler_deallocate (void* pointer, size_t size, LoggerRefHandler* self) {
+        handler_hooks::deallocate(pointer, size, self->original());
+    }
+
+    template <class Function>
+    friend void asio_handler_invoke (Function&& f, LoggerRefHandler* self) {
+        handler_hooks::invoke(std::forward<Function>(f), self->original());
+    }
+
+    friend bool asio_handler_is_continuation (LoggerRefHandler* self) {
+        return handler_hooks::is_continuation(self->original());
+    }
+
+    friend log::Logger& getAssociatedLogger (const LoggerRefHandler& self) {
+        return self.log();
+    }
+
+private:
+    WrappedHandlerType mHandler;
+    log::Logger* mLog;
+};
+
 } // _
 
 template <class CompletionToken>
@@ -144,6 +214,19 @@ addAssociatedLogger (CompletionToken&& token, const log::Logger& lg = {}) {
     return { std::forward<CompletionToken>(token), lg };
 }
 
+template <class CompletionToken>
+_::LoggerRefCompletionToken<std::decay_t<CompletionToken>>
+addAssociatedLoggerRef (CompletionToken&& token, log::Logger& lg) {
+    // Associate a logger with a completion token by reference. This is the cheap alternative to
+    // `addAssociatedLogger`, which copies the logger into a heap-allocated block for every
+    // handler. The caller is responsible for keeping `lg` alive until the operation completes,
+    // which is why there is no default argument and temporaries are rejected.
+    return { std::forward<CompletionToken>(token), lg };
+}
+
+template <class CompletionToken>
+void addAssociatedLoggerRef (CompletionToken&& token, log::Logger&& lg) = delete;
+
 }}} // namespace util::asio::v2
 
 namespace boost { namespace asio {
@@ -170,6 +253,28 @@ struct handler_type<::util::asio::_::LoggerCompletionToken<CompletionToken>, Sig
     using type = ::util::asio::_::LoggerHandler<CompletionToken, Signature>;
 };
 
+template <class CompletionToken, class Signature>
+struct async_result<::util::asio::_::LoggerRefHandler<CompletionToken, Signature>> {
+    using WrappedHandlerType
+        = typename ::util::asio::_::LoggerRefHandler<CompletionToken, Signature>::WrappedHandlerType;
+
+public:
+    using type = typename async_result<WrappedHandlerType>::type;
+    async_result (::util::asio::_::LoggerRefHandler<CompletionToken, Signature>& handler)
+        : mResult(handler.original())
+    {}
+
+    type get () { return mResult.get(); }
+
+private:
+    async_result<WrappedHandlerType> mResult;
+};
+
+template <class CompletionToken, class Signature>
+struct handler_type<::util::asio::_::LoggerRefCompletionToken<CompletionToken>, Signature> {
+    using type = ::util::asio::_::LoggerRefHandler<CompletionToken, Signature>;
+};
+
 }} // namespace boost::asio
 
 #endif
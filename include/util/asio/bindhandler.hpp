@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_BINDHANDLER_HPP
+#define UTIL_ASIO_BINDHANDLER_HPP
+
+#include <util/asio/handler_hooks.hpp>
+#include <util/asio/associatedlogger.hpp>
+#include <util/applytuple.hpp>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace util { namespace asio {
+
+template <class Handler, class... Args>
+class BoundHandler {
+    // A nullary function object which invokes a handler with a stored set of arguments. It is
+    // meant to be passed to `io_service::post()` or `io_service::dispatch()` to deliver a
+    // completion. Unlike the result of `std::bind`, it forwards the allocation, invocation, and
+    // continuation hooks to the wrapped handler, so the io_service's operation storage comes from
+    // the handler's allocator rather than the default one.
+
+public:
+    template <class H, class Tuple>
+    BoundHandler (H&& h, Tuple&& args)
+        : mHandler(std::forward<H>(h))
+        , mArgs(std::forward<Tuple>(args))
+    {}
+
+    void operator() () {
+        applyTuple(mHandler, mArgs);
+    }
+
+    Handler& handler () { return mHandler; }
+
+    friend void* asio_handler_allocate (size_t size, BoundHandler* self) {
+        return handler_hooks::allocate(size, self->handler());
+    }
+
+    friend void asio_handler_deallocate (void* pointer, size_t size, BoundHandler* self) {
+        handler_hooks::deallocate(pointer, size, self->handler());
+    }
+
+    template <class Function>
+    friend void asio_handler_invoke (Function&& f, BoundHandler* self) {
+        handler_hooks::invoke(std::forward<Function>(f), self->handler());
+    }
+
+    friend bool asio_handler_is_continuation (BoundHandler* self) {
+        return handler_hooks::is_continuation(self->handler());
+    }
+
+    friend log::Logger& getAssociatedLogger (const BoundHandler& self) {
+        return getAssociatedLogger(self.mHandler);
+    }
+
+private:
+    Handler mHandler;
+    std::tuple<Args...> mArgs;
+};
+
+// Move or copy a handler and its completion arguments into a BoundHandler, e.g.:
+//   context.dispatch(bindHandler(std::move(handler), ec, nBytes));
+template <class Handler, class... Args>
+BoundHandler<std::decay_t<Handler>, std::decay_t<Args>...>
+bindHandler (Handler&& h, Args&&... args) {
+    return { std::forward<Handler>(h), std::forward_as_tuple(std::forward<Args>(args)...) };
+}
+
+}} // namespace util::asio
+
+#endif
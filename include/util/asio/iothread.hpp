@@ -17,6 +17,9 @@ namespace util { namespace asio {
 class IoThread {
 public:
     IoThread ();
+    explicit IoThread (unsigned cpu);
+    // Pin the thread to the given CPU before running the io_service. Pinning is best-effort, and
+    // is only implemented on Linux.
     ~IoThread ();
 
     size_t join ();
@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_IOTHREADPOOL_HPP
+#define UTIL_ASIO_IOTHREADPOOL_HPP
+
+#include <util/asio/iothread.hpp>
+
+#include <boost/asio/io_service.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace util { namespace asio {
+
+class IoThreadPool {
+    // A set of shards, each consisting of one io_service run by one IoThread pinned to its own
+    // CPU. I/O objects constructed on a shard's io_service are confined to that shard's thread,
+    // so their implementations need no cross-thread synchronization.
+    //
+    // Each shard has a load count, maintained by whoever distributes work across the shards
+    // (e.g., `ws::ShardedAcceptor` counts live connections) through `Load` objects.
+
+public:
+    explicit IoThreadPool (size_t size = defaultSize());
+    // Shard i's thread is pinned to CPU i modulo the number of hardware threads.
+
+    size_t join ();
+    // Let each io_service run out of work and join its thread. Returns the total number of
+    // handlers run.
+
+    size_t size () const { return mThreads.size(); }
+
+    boost::asio::io_service& context (size_t shard) {
+        return mThreads.at(shard)->context();
+    }
+
+    size_t load (size_t shard) const {
+        return mLoads[shard].load(std::memory_order_relaxed);
+    }
+
+    size_t leastLoaded () const;
+    // Index of the shard with the smallest load count. Ties go to the lowest index.
+
+    class Load {
+        // Movable token which holds one unit of load on a shard for its lifetime. A Load must not
+        // outlive its pool, except inside handlers and I/O objects of the pool's own io_services,
+        // which the pool destroys before its load counts.
+    public:
+        Load () = default;
+        Load (Load&& other) : mCount(other.mCount) { other.mCount = nullptr; }
+        Load& operator= (Load&& other) {
+            reset();
+            mCount = other.mCount;
+            other.mCount = nullptr;
+            return *this;
+        }
+        ~Load () { reset(); }
+
+        void reset () {
+            if (mCount) {
+                mCount->fetch_sub(1, std::memory_order_relaxed);
+                mCount = nullptr;
+            }
+        }
+
+    private:
+        friend class IoThreadPool;
+        explicit Load (std::atomic<size_t>& count) : mCount(&count) {
+            mCount->fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::atomic<size_t>* mCount = nullptr;
+    };
+
+    Load acquireLoad (size_t shard) { return Load{mLoads[shard]}; }
+
+    static size_t defaultSize ();
+    // One shard per hardware thread.
+
+private:
+    std::unique_ptr<std::atomic<size_t>[]> mLoads;
+    std::vector<std::unique_ptr<IoThread>> mThreads;
+    // Declared after mLoads, so the threads are joined, and their io_services' pending handlers
+    // (which may own Loads) destroyed, while the load counts still exist.
+};
+
+}} // namespace util::asio
+
+#endif
@@ -8,6 +8,7 @@
 
 #include <util/asio/operation.hpp>
 #include <util/log.hpp>
+#include <util/logratelimit.hpp>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/serial_port.hpp>
@@ -118,7 +119,8 @@ inline auto SerialPortOpener::asyncOpenUntilSuccess (boost::asio::serial_port& s
                 settleDelay, writeDelay, std::move(op)
             );
             while (ec) {
-                BOOST_LOG(op.log()) << "asyncOpen: " << ec.message();
+                UTIL_LOG_RATE_LIMITED(op.log(), util::log::Level::info, 1, 5)
+                    << "asyncOpen: " << ec.message();
                 if (mTimer.expires_at() == boost::asio::steady_timer::time_point::min()) {
                     return;
                 }
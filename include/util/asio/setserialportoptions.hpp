@@ -49,6 +49,7 @@ void tenaciousSetOption (boost::asio::serial_port& sp, Option value, const int m
         // during set_option() which interfere with the Linkbot bootloader.
         // EDIT: We have found the emitting a log message seems to fix this
         // issue more absolutely than using tcflush(). Why? Who knows.
+        // This record is load-bearing, so it must not become a filtered UTIL_LOG_* call.
 #if BOOST_OS_MACOS
         BOOST_LOG(lg) << "Setting serial port option...";
         //tcflush(sp.lowest_layer().native_handle(), TCIOFLUSH);
@@ -61,7 +62,7 @@ void tenaciousSetOption (boost::asio::serial_port& sp, Option value, const int m
              && ++attempts != maxAttempts
              && ec);
     if (attempts > 1) {
-        BOOST_LOG(lg) << "set serial option after " << attempts << " attempts";
+        UTIL_LOG_DEBUG(lg) << "set serial option after " << attempts << " attempts";
     }
     if (ec) {
         throw boost::system::system_error(ec);
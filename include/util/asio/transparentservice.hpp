@@ -8,20 +8,94 @@
 
 #include <util/asio/handler_hooks.hpp>
 #include <util/asio/associatedlogger.hpp>
+#include <util/asio/bindhandler.hpp>
 #include <util/index_sequence.hpp>
 
 #include <boost/asio/async_result.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/basic_io_object.hpp>
 
+#include <boost/optional.hpp>
+#include <boost/utility/in_place_factory.hpp>
+
 #include <functional>
 #include <memory>
+#include <type_traits>
 #include <utility>
 
+#include <cassert>
+
 namespace util { namespace asio {
 
 inline namespace v2 {
 
+namespace _ {
+template <class CompletionToken, class Signature>
+class CountedTransparentHandler;
+} // _
+
+class OperationCounter {
+    // Base class for `TransparentService` implementations which opt into lightweight handlers.
+    //
+    // By default, every handler produced by a `TransparentService` owns an `io_service::work`
+    // object and a `shared_ptr` to the implementation, so every handler copy costs two atomic
+    // increments. If an implementation derives from `OperationCounter`, its handlers instead hold
+    // a raw pointer to this object, which counts outstanding operations with a plain integer. A
+    // single work object and a single `shared_ptr` to the implementation are held only while the
+    // count is non-zero, so the atomic operations happen on the 0 -> 1 and 1 -> 0 transitions,
+    // not on every handler copy or move.
+    //
+    // Because the count is not atomic, an implementation deriving from `OperationCounter` MUST
+    // be confined to a single thread: its initiating functions must be called from, and its
+    // `io_service` must be run by, that one thread.
+
+public:
+    explicit OperationCounter (boost::asio::io_service& context)
+        : mContext(context)
+    {}
+
+    OperationCounter (const OperationCounter&) = delete;
+    OperationCounter& operator= (const OperationCounter&) = delete;
+
+    ~OperationCounter () {
+        assert(!mCount);
+    }
+
+    boost::asio::io_service& context () const { return mContext; }
+    size_t outstandingOperations () const { return mCount; }
+
+private:
+    template <class CompletionToken, class Signature>
+    friend class _::CountedTransparentHandler;
+
+    template <class Impl>
+    void acquire (const std::shared_ptr<Impl>& impl) {
+        if (!mCount++) {
+            mWork = boost::in_place(std::ref(mContext));
+            mSelf = impl;
+        }
+    }
+
+    void addRef () {
+        assert(mCount);
+        ++mCount;
+    }
+
+    void release () {
+        assert(mCount);
+        if (!--mCount) {
+            // Resetting mSelf may destroy *this, so move it out and touch nothing afterward.
+            mWork = boost::none;
+            auto self = std::move(mSelf);
+        }
+    }
+
+    boost::asio::io_service& mContext;
+    size_t mCount = 0;
+    boost::optional<boost::asio::io_service::work> mWork;
+    std::shared_ptr<void> mSelf;
+};
+
 namespace _ {
 
 template <class CompletionToken>
@@ -45,6 +119,7 @@ public:
     TransparentCompletionToken (
             boost::asio::io_service& context, std::shared_ptr<void> impl, CT&& token)
         : mContext(context)
+        , mImpl(std::move(impl))
         , mToken(std::forward<CT>(token))
     {}
 
@@ -73,10 +148,17 @@ public:
     // Implicitly generated copy/move ctors/operations are fine. If the compiler tells you the copy
     // constructor is deleted, it's likely because mHandler is noncopyable. Check for raw
     // references in std::bind expressions (they must be wrapped in std::ref or std::cref).
+    //
+    // Invoking a TransparentHandler moves the wrapped handler out of it, so each TransparentHandler
+    // may only be invoked once.
 
     template <class... Params>
     void operator() (Params&&... ps) {
-        mWork.get_io_service().dispatch(std::bind(mHandler, std::forward<Params>(ps)...));
+        // Move the wrapped handler and its results into a BoundHandler, which uses the wrapped
+        // handler's allocation hooks if the io_service needs to store it. If we are already
+        // running inside the io_service, dispatch() invokes it immediately.
+        mWork.get_io_service().dispatch(
+                bindHandler(std::move(mHandler), std::forward<Params>(ps)...));
     }
 
     WrappedHandlerType& original () { return mHandler; }
@@ -111,6 +193,102 @@ private:
     WrappedHandlerType mHandler;
 };
 
+template <class CompletionToken, class Impl>
+class CountedTransparentCompletionToken {
+    // The `OperationCounter` equivalent of `TransparentCompletionToken`. It keeps the
+    // implementation alive for as long as it exists itself, but handlers constructed from it only
+    // copy the implementation's `shared_ptr` if they are its first outstanding operation.
+
+public:
+    template <class CT>
+    CountedTransparentCompletionToken (const std::shared_ptr<Impl>& impl, CT&& token)
+        : mImpl(impl)
+        , mToken(std::forward<CT>(token))
+    {}
+
+    const std::shared_ptr<Impl>& impl () const { return mImpl; }
+    CompletionToken original () const { return mToken; }
+
+private:
+    std::shared_ptr<Impl> mImpl;
+    CompletionToken mToken;
+};
+
+template <class CompletionToken, class Signature>
+class CountedTransparentHandler {
+public:
+    using WrappedHandlerType
+        = typename boost::asio::handler_type<CompletionToken, Signature>::type;
+
+    template <class Impl>
+    CountedTransparentHandler (const CountedTransparentCompletionToken<CompletionToken, Impl>& token)
+        : mCounter(token.impl().get())
+        , mHandler(token.original())
+    {
+        mCounter->acquire(token.impl());
+    }
+
+    CountedTransparentHandler (const CountedTransparentHandler& other)
+        : mCounter(other.mCounter)
+        , mHandler(other.mHandler)
+    {
+        if (mCounter) {
+            mCounter->addRef();
+        }
+    }
+
+    CountedTransparentHandler (CountedTransparentHandler&& other)
+        : mCounter(other.mCounter)
+        , mHandler(std::move(other.mHandler))
+    {
+        other.mCounter = nullptr;
+    }
+
+    CountedTransparentHandler& operator= (const CountedTransparentHandler&) = delete;
+    CountedTransparentHandler& operator= (CountedTransparentHandler&&) = delete;
+
+    ~CountedTransparentHandler () {
+        if (mCounter) {
+            mCounter->release();
+        }
+    }
+
+    template <class... Params>
+    void operator() (Params&&... ps) {
+        assert(mCounter);
+        mCounter->context().dispatch(
+                bindHandler(std::move(mHandler), std::forward<Params>(ps)...));
+    }
+
+    WrappedHandlerType& original () { return mHandler; }
+
+    friend void* asio_handler_allocate (size_t size, CountedTransparentHandler* self) {
+        return handler_hooks::allocate(size, self->original());
+    }
+
+    friend void asio_handler_deallocate (void* pointer, size_t size,
+            CountedTransparentHandler* self) {
+        handler_hooks::deallocate(pointer, size, self->original());
+    }
+
+    template <class Function>
+    friend void asio_handler_invoke (Function&& f, CountedTransparentHandler* self) {
+        handler_hooks::invoke(std::forward<Function>(f), self->original());
+    }
+
+    friend bool asio_handler_is_continuation (CountedTransparentHandler* self) {
+        return handler_hooks::is_continuation(self->original());
+    }
+
+    friend log::Logger& getAssociatedLogger (const CountedTransparentHandler& self) {
+        return getAssociatedLogger(self.mHandler);
+    }
+
+private:
+    OperationCounter* mCounter;  // Null only in a moved-from handler.
+    WrappedHandlerType mHandler;
+};
+
 }}}} // util::asio::v2::_
 
 namespace boost { namespace asio {
@@ -137,6 +315,29 @@ struct handler_type<::util::asio::_::TransparentCompletionToken<CompletionToken>
     using type = ::util::asio::_::TransparentHandler<CompletionToken, Signature>;
 };
 
+template <class CompletionToken, class Signature>
+struct async_result<::util::asio::_::CountedTransparentHandler<CompletionToken, Signature>> {
+    using WrappedHandlerType = typename ::util::asio::_::CountedTransparentHandler<
+            CompletionToken, Signature>::WrappedHandlerType;
+
+public:
+    using type = typename async_result<WrappedHandlerType>::type;
+    async_result (::util::asio::_::CountedTransparentHandler<CompletionToken, Signature>& handler)
+        : mResult(handler.original())
+    {}
+
+    type get () { return mResult.get(); }
+
+private:
+    async_result<WrappedHandlerType> mResult;
+};
+
+template <class CompletionToken, class Impl, class Signature>
+struct handler_type<
+        ::util::asio::_::CountedTransparentCompletionToken<CompletionToken, Impl>, Signature> {
+    using type = ::util::asio::_::CountedTransparentHandler<CompletionToken, Signature>;
+};
+
 }} // boost::asio
 
 namespace util { namespace asio {
@@ -177,17 +378,34 @@ public:
     }
 
     template <class CompletionToken>
-    auto transformCompletionToken (implementation_type impl, CompletionToken&& token) {
+    auto transformCompletionToken (const implementation_type& impl, CompletionToken&& token) {
         // Make sure the event loop's work flag is set, and the implementation object is alive,
         // for the duration of the operation.
+        return transformCompletionToken(impl, std::forward<CompletionToken>(token),
+                std::is_base_of<OperationCounter, Impl>{});
+    }
+
+private:
+    template <class CompletionToken>
+    auto transformCompletionToken (const implementation_type& impl, CompletionToken&& token,
+            std::false_type) {
         return _::TransparentCompletionToken<std::decay_t<CompletionToken>>{
             get_io_service(),
-            std::move(impl),
+            impl,
+            std::forward<CompletionToken>(token)
+        };
+    }
+
+    template <class CompletionToken>
+    auto transformCompletionToken (const implementation_type& impl, CompletionToken&& token,
+            std::true_type) {
+        // The implementation counts its own outstanding operations. See `OperationCounter`.
+        return _::CountedTransparentCompletionToken<std::decay_t<CompletionToken>, Impl>{
+            impl,
             std::forward<CompletionToken>(token)
         };
     }
 
-private:
     void shutdown_service () {}
 };
 
@@ -239,7 +457,7 @@ public: \
 private: \
     template <class Tuple, size_t... NMinusOneIndices> \
     auto methodName##Impl (Tuple&& t, util::index_sequence<NMinusOneIndices...>&&) { \
-        auto impl = this->get_implementation(); \
+        auto& impl = this->get_implementation(); \
         return impl->methodName( \
             std::get<NMinusOneIndices>(t)..., \
             this->get_service().transformCompletionToken( \
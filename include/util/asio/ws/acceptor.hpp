@@ -24,29 +24,31 @@
 
 namespace util { namespace asio { namespace ws {
 
-class AcceptorImpl : public std::enable_shared_from_this<AcceptorImpl> {
-public:
-    // Server config with asio transport, TLS disabled, and Boost.Log logging
-    struct Config : public ::websocketpp::config::asio {
-        typedef Config type;
-        typedef ::websocketpp::config::asio base;
-
-        typedef Logger<base::concurrency_type, ::websocketpp::log::elevel> elog_type;
-        typedef Logger<base::concurrency_type, ::websocketpp::log::alevel> alog_type;
+// Server config with asio transport, TLS disabled, and Boost.Log logging
+struct ServerConfig : public ::websocketpp::config::asio {
+    typedef ServerConfig type;
+    typedef ::websocketpp::config::asio base;
 
-        struct transport_config : public base::transport_config {
-            typedef type::alog_type alog_type;
-            typedef type::elog_type elog_type;
-        };
+    typedef Logger<base::concurrency_type, ::websocketpp::log::elevel> elog_type;
+    typedef Logger<base::concurrency_type, ::websocketpp::log::alevel> alog_type;
 
-        typedef ::websocketpp::transport::asio::endpoint<transport_config> transport_type;
+    struct transport_config : public base::transport_config {
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
     };
 
+    typedef ::websocketpp::transport::asio::endpoint<transport_config> transport_type;
+};
+
+template <class ConfigType>
+class BasicAcceptorImpl : public std::enable_shared_from_this<BasicAcceptorImpl<ConfigType>> {
+public:
+    using Config = ConfigType;
     using Connection = ::websocketpp::connection<Config>;
-    using ConnectionPtr = Connection::ptr;
+    using ConnectionPtr = typename Connection::ptr;
     using MessageQueue = ::util::asio::ws::MessageQueue<Config>;
 
-    explicit AcceptorImpl (boost::asio::io_service& ios)
+    explicit BasicAcceptorImpl (boost::asio::io_service& ios)
         : mContext(ios)
     {
         mWsServer.init_asio(&mContext);
@@ -89,8 +91,8 @@ public:
 
     void listen (const boost::asio::ip::tcp::endpoint& endpoint) {
         auto self = this->shared_from_this();
-        mWsServer.set_open_handler(std::bind(&AcceptorImpl::handleOpen, self, _1));
-        mWsServer.set_fail_handler(std::bind(&AcceptorImpl::handleOpen, self, _1));
+        mWsServer.set_open_handler(std::bind(&BasicAcceptorImpl::handleOpen, self, _1));
+        mWsServer.set_fail_handler(std::bind(&BasicAcceptorImpl::handleOpen, self, _1));
         mWsServer.set_reuse_addr(true);
         mWsServer.listen(endpoint);
         mWsServer.start_accept();
@@ -150,10 +152,11 @@ private:
     mutable util::log::Logger mLog;
 };
 
-class Acceptor : public util::asio::TransparentIoObject<AcceptorImpl> {
+template <class Config>
+class BasicAcceptor : public util::asio::TransparentIoObject<BasicAcceptorImpl<Config>> {
 public:
-    explicit Acceptor (boost::asio::io_service& ios)
-        : util::asio::TransparentIoObject<AcceptorImpl>(ios)
+    explicit BasicAcceptor (boost::asio::io_service& ios)
+        : util::asio::TransparentIoObject<BasicAcceptorImpl<Config>>(ios)
     {}
 
     void listen (const boost::asio::ip::tcp::endpoint& ep) {
@@ -164,10 +167,13 @@ public:
         return this->get_implementation()->getLocalEndpoint();
     }
 
-    using MessageQueue = AcceptorImpl::MessageQueue;
+    using MessageQueue = typename BasicAcceptorImpl<Config>::MessageQueue;
     UTIL_ASIO_DECL_ASYNC_METHOD(asyncAccept)
 };
 
+using AcceptorImpl = BasicAcceptorImpl<ServerConfig>;
+using Acceptor = BasicAcceptor<ServerConfig>;
+
 }}} // namespace util::asio::ws
 
 #endif
@@ -0,0 +1,250 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_WS_CONNECTIONPOOL_HPP
+#define UTIL_ASIO_WS_CONNECTIONPOOL_HPP
+
+#include <util/log.hpp>
+#include <util/logratelimit.hpp>
+
+#include <util/asio/asynccompletion.hpp>
+#include <util/asio/transparentservice.hpp>
+
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/messagequeue.hpp>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace util { namespace asio { namespace ws {
+
+template <class ConfigType>
+class BasicConnectionPoolImpl
+        : public std::enable_shared_from_this<BasicConnectionPoolImpl<ConfigType>> {
+    // Keep up to `getWarmCount()` open WebSocket connections to each host:service we have been
+    // asked to connect to, so that `asyncConnect` can usually complete immediately, without a
+    // TCP or HTTP upgrade handshake. Every connection handed out is replaced in the background.
+    //
+    // A warm connection is a `MessageQueue` like any other: messages the server sends before it is
+    // handed out are queued in it. Warm connections the server has closed are discarded at
+    // hand-out. A failed background connect is not retried until the next `asyncConnect` or
+    // `warmUp` for that target, so an unreachable host costs one attempt per request, not a
+    // reconnect loop.
+
+public:
+    using Config = ConfigType;
+    using MessageQueue = ::util::asio::ws::MessageQueue<Config>;
+    using MessageQueuePtr = std::shared_ptr<MessageQueue>;
+
+    static constexpr size_t defaultWarmCount = 2;
+
+    explicit BasicConnectionPoolImpl (boost::asio::io_service& context)
+        : mContext(context)
+        , mConnector(context)
+    {}
+
+    void close (boost::system::error_code& ec) {
+        ec = {};
+        auto self = this->shared_from_this();
+        mContext.post([self, this] {
+            mClosed = true;
+            auto ec2 = boost::system::error_code{};
+            mConnector.close(ec2);
+            for (auto&& pair : mTargets) {
+                for (auto& mq : pair.second.warm) {
+                    mq->close(ec2);
+                }
+            }
+            mTargets.clear();
+            mReadyCount = 0;
+        });
+    }
+
+    size_t getWarmCount () const {
+        return mWarmCount;
+    }
+
+    void setWarmCount (size_t count) {
+        // Takes effect at each target's next `asyncConnect` or `warmUp`. Lowering the count does
+        // not close connections which are already warm.
+        mWarmCount = count;
+    }
+
+    size_t getReadyCount () const {
+        // Warm connections, across all targets, which are open and waiting to be handed out.
+        return mReadyCount;
+    }
+
+    void warmUp (const std::string& host, const std::string& service) {
+        // Start warming connections to host:service ahead of the first `asyncConnect`.
+        auto self = this->shared_from_this();
+        mContext.post([host, service, self, this] {
+            if (!mClosed) {
+                replenish(getTarget(host, service));
+            }
+        });
+    }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+            void(boost::system::error_code, MessageQueuePtr))
+    asyncConnect (const std::string& host, const std::string& service, CompletionToken&& token) {
+        // Complete with a warm connection to host:service if there is one, otherwise with a new
+        // connection, made on the request path as `Connector::asyncConnect` would.
+        util::asio::AsyncCompletion<
+            CompletionToken, void(boost::system::error_code, MessageQueuePtr)
+        > init { std::forward<CompletionToken>(token) };
+
+        auto& handler = init.handler;
+        auto self = this->shared_from_this();
+        mContext.post([host, service, handler, self, this]() mutable {
+            if (mClosed) {
+                handler(boost::asio::error::operation_aborted, nullptr);
+                return;
+            }
+            auto& target = getTarget(host, service);
+            auto mq = takeWarm(target);
+            if (mq) {
+                handler(boost::system::error_code{}, std::move(mq));
+            }
+            else {
+                connect(host, service, handler);
+            }
+            replenish(target);
+        });
+
+        return init.result.get();
+    }
+
+private:
+    struct Target {
+        std::string host;
+        std::string service;
+        std::deque<MessageQueuePtr> warm;
+        size_t connecting = 0;
+    };
+
+    Target& getTarget (const std::string& host, const std::string& service) {
+        // std::unordered_map never moves its elements, so the reference stays valid until
+        // close() clears the map.
+        auto& target = mTargets[host + ':' + service];
+        if (target.host.empty()) {
+            target.host = host;
+            target.service = service;
+        }
+        return target;
+    }
+
+    MessageQueuePtr takeWarm (Target& target) {
+        while (!target.warm.empty()) {
+            auto mq = std::move(target.warm.front());
+            target.warm.pop_front();
+            --mReadyCount;
+            if (mq->isOpen()) {
+                return mq;
+            }
+            BOOST_LOG(mLog) << "Discarding closed warm connection to "
+                << target.host << ':' << target.service;
+        }
+        return nullptr;
+    }
+
+    template <class Handler>
+    void connect (const std::string& host, const std::string& service, Handler&& handler) {
+        // Call `handler(ec, mq)` on mContext with a new connection.
+        auto mq = std::make_shared<MessageQueue>(mContext);
+        mConnector.asyncConnect(*mq, host, service,
+                [mq, handler = std::forward<Handler>(handler)]
+                (boost::system::error_code ec) mutable {
+            handler(ec, ec ? nullptr : std::move(mq));
+        });
+    }
+
+    void replenish (Target& target) {
+        auto self = this->shared_from_this();
+        while (target.warm.size() + target.connecting < mWarmCount) {
+            ++target.connecting;
+            connect(target.host, target.service, [self, this, &target]
+                    (boost::system::error_code ec, MessageQueuePtr mq) {
+                if (mClosed) {
+                    // `target` is gone.
+                    if (mq) {
+                        mq->close(ec);
+                    }
+                    return;
+                }
+                --target.connecting;
+                if (ec) {
+                    UTIL_LOG_RATE_LIMITED(mLog, util::log::Level::warning, 1, 5)
+                        << "Could not warm a connection to " << target.host << ':'
+                        << target.service << ": " << ec.message();
+                    return;
+                }
+                target.warm.push_back(std::move(mq));
+                ++mReadyCount;
+            });
+        }
+    }
+
+    boost::asio::io_service& mContext;
+    BasicConnector<Config> mConnector;
+    std::unordered_map<std::string, Target> mTargets;
+    bool mClosed = false;
+    // Touched only on mContext.
+
+    std::atomic<size_t> mWarmCount {defaultWarmCount};
+    std::atomic<size_t> mReadyCount {0};
+
+    mutable util::log::Logger mLog;
+};
+
+template <class Config>
+constexpr size_t BasicConnectionPoolImpl<Config>::defaultWarmCount;
+
+template <class Config>
+class BasicConnectionPool
+        : public util::asio::TransparentIoObject<BasicConnectionPoolImpl<Config>> {
+    // Like `Connector`, but with warm connections kept ready per host:service. The completion
+    // signature of `asyncConnect` is `void(error_code, MessageQueuePtr)`: the pool, not the
+    // caller, constructs the `MessageQueue`, on the pool's io_service.
+
+public:
+    explicit BasicConnectionPool (boost::asio::io_service& context,
+            size_t warmCount = BasicConnectionPoolImpl<Config>::defaultWarmCount)
+        : util::asio::TransparentIoObject<BasicConnectionPoolImpl<Config>>(context)
+    {
+        this->get_implementation()->setWarmCount(warmCount);
+    }
+
+    size_t getWarmCount () const {
+        return this->get_implementation()->getWarmCount();
+    }
+
+    void setWarmCount (size_t count) {
+        this->get_implementation()->setWarmCount(count);
+    }
+
+    size_t getReadyCount () const {
+        return this->get_implementation()->getReadyCount();
+    }
+
+    void warmUp (const std::string& host, const std::string& service) {
+        this->get_implementation()->warmUp(host, service);
+    }
+
+    using MessageQueue = typename BasicConnectionPoolImpl<Config>::MessageQueue;
+    using MessageQueuePtr = typename BasicConnectionPoolImpl<Config>::MessageQueuePtr;
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncConnect)
+};
+
+using ConnectionPool = BasicConnectionPool<ClientConfig>;
+
+}}} // namespace util::asio::ws
+
+#endif
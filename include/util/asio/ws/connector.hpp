@@ -18,34 +18,55 @@
 #include <websocketpp/close.hpp>
 #include <websocketpp/config/asio_no_tls_client.hpp>
 
+#include <memory>
+#include <string>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace util { namespace asio { namespace ws {
 
-class ConnectorImpl : public std::enable_shared_from_this<ConnectorImpl> {
-public:
-    // Client config with asio transport, TLS disabled, and Boost.Log logging
-    struct Config : public ::websocketpp::config::asio_client {
-        typedef Config type;
-        typedef ::websocketpp::config::asio_client base;
-
-        typedef Logger<base::concurrency_type, ::websocketpp::log::elevel> elog_type;
-        typedef Logger<base::concurrency_type, ::websocketpp::log::alevel> alog_type;
+// Client config with asio transport, TLS disabled, and Boost.Log logging
+struct ClientConfig : public ::websocketpp::config::asio_client {
+    typedef ClientConfig type;
+    typedef ::websocketpp::config::asio_client base;
 
-        struct transport_config : public base::transport_config {
-            typedef type::alog_type alog_type;
-            typedef type::elog_type elog_type;
-        };
+    typedef Logger<base::concurrency_type, ::websocketpp::log::elevel> elog_type;
+    typedef Logger<base::concurrency_type, ::websocketpp::log::alevel> alog_type;
 
-        typedef ::websocketpp::transport::asio::endpoint<transport_config> transport_type;
+    struct transport_config : public base::transport_config {
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
     };
 
+    typedef ::websocketpp::transport::asio::endpoint<transport_config> transport_type;
+};
+
+struct ConnectTarget {
+    std::string host;
+    std::string service;
+};
+
+template <class ConfigType>
+class BasicConnectorImpl : public std::enable_shared_from_this<BasicConnectorImpl<ConfigType>> {
+public:
+    using Config = ConfigType;
     using Connection = ::websocketpp::connection<Config>;
-    using ConnectionPtr = Connection::ptr;
+    using ConnectionPtr = typename Connection::ptr;
     using MessageQueue = ::util::asio::ws::MessageQueue<Config>;
+    using MessageQueuePtr = std::shared_ptr<MessageQueue>;
+
+    struct ConnectResult {
+        boost::system::error_code ec;
+        MessageQueuePtr mq;
+        // Null if ec is set.
+    };
+
+    using ConnectManyHandlerSignature
+        = void(boost::system::error_code, std::vector<ConnectResult>);
 
-    explicit ConnectorImpl (boost::asio::io_service& context)
+    explicit BasicConnectorImpl (boost::asio::io_service& context)
         : mContext(context)
     {
         mWsClient.init_asio(&mContext);
@@ -68,11 +89,11 @@ public:
     void init () {
         // Called immediately post-construction. AcceptorImpl now has access to shared_from_this().
         auto self = this->shared_from_this();
-        mWsClient.set_open_handler(std::bind(&ConnectorImpl::handleOpen, self, _1));
-        mWsClient.set_fail_handler(std::bind(&ConnectorImpl::handleFail, self, _1));
+        mWsClient.set_open_handler(std::bind(&BasicConnectorImpl::handleOpen, self, _1));
+        mWsClient.set_fail_handler(std::bind(&BasicConnectorImpl::handleFail, self, _1));
     }
 
-    ~ConnectorImpl () {
+    ~BasicConnectorImpl () {
         boost::system::error_code ec;
         close(ec);
     }
@@ -81,7 +102,12 @@ public:
         auto self = this->shared_from_this();
         ec = {};
         mContext.post([self, this, ec]() mutable {
-            for (auto&& conPair : mNascentConnections) {
+            // The handlers may start new connections, so detach the ones we are aborting first.
+            // asyncConnectMany operations see mClosing and abort their unstarted targets.
+            auto nascent = std::move(mNascentConnections);
+            mNascentConnections.clear();
+            mClosing = true;
+            for (auto&& conPair : nascent) {
                 // Don't want first->close() to accidentally call the handler, which we will go
                 // ahead and do ourselves.
                 conPair.first->set_open_handler(nullptr);
@@ -93,7 +119,7 @@ public:
                 }
                 conPair.second.handler(boost::asio::error::operation_aborted);
             }
-            mNascentConnections.clear();
+            mClosing = false;
         });
     }
 
@@ -111,28 +137,111 @@ public:
         auto& handler = init.handler;
         auto self = this->shared_from_this();
         mContext.post([&mq, uri, handler, self, this]() mutable {
-            auto ec = boost::system::error_code{};
-            auto con = mWsClient.get_connection(uri, ec);
-            if (ec) {
-                handler(ec);
-                return;
-            }
-            bool success;
-            std::tie(std::ignore, success) = mNascentConnections.insert(
-                std::make_pair(con, NascentConnectionData{handler, std::ref(mq)}));
-            if (success) {
-                mWsClient.connect(con);
-            }
-            else {
-                assert(false);
-                handler(boost::asio::error::operation_aborted); // FIXME come up with a real error?
-            }
+            startConnect(uri, mq, std::move(handler));
+        });
+
+        return init.result.get();
+    }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, ConnectManyHandlerSignature)
+    asyncConnectMany (std::vector<ConnectTarget> targets, size_t maxInFlight,
+            CompletionToken&& token)
+    {
+        // Connect to every target, with no more than `maxInFlight` handshakes outstanding at
+        // once, and complete once all of them have succeeded or failed. `results[i]` is target
+        // i's outcome. The operation's own error is operation_aborted if close() kept some
+        // targets from being attempted, and success otherwise, even if every target failed.
+        util::asio::AsyncCompletion<
+            CompletionToken, ConnectManyHandlerSignature
+        > init { std::forward<CompletionToken>(token) };
+
+        assert(maxInFlight > 0);
+        auto op = std::make_shared<ConnectManyOp>();
+        op->results.resize(targets.size());
+        op->targets = std::move(targets);
+        op->maxInFlight = maxInFlight;
+        op->handler = init.handler;
+        auto self = this->shared_from_this();
+        mContext.post([op, self, this] {
+            continueConnectMany(op);
         });
 
         return init.result.get();
     }
 
 private:
+    struct ConnectManyOp {
+        std::vector<ConnectTarget> targets;
+        std::vector<ConnectResult> results;
+        size_t maxInFlight;
+        size_t next = 0;
+        size_t inFlight = 0;
+        size_t done = 0;
+        bool aborted = false;
+        bool starting = false;
+        std::function<ConnectManyHandlerSignature> handler;
+    };
+
+    void startConnect (::websocketpp::uri_ptr uri, MessageQueue& mq,
+            std::function<void(boost::system::error_code)> handler) {
+        auto ec = boost::system::error_code{};
+        auto con = mWsClient.get_connection(uri, ec);
+        if (ec) {
+            handler(ec);
+            return;
+        }
+        bool success;
+        std::tie(std::ignore, success) = mNascentConnections.insert(
+            std::make_pair(con, NascentConnectionData{handler, std::ref(mq)}));
+        if (success) {
+            mWsClient.connect(con);
+        }
+        else {
+            assert(false);
+            handler(boost::asio::error::operation_aborted); // FIXME come up with a real error?
+        }
+    }
+
+    void continueConnectMany (const std::shared_ptr<ConnectManyOp>& op) {
+        // Fill op's window with new handshakes, or complete op if every target is done. A
+        // handshake can fail synchronously, re-entering us from the loop below; `starting`
+        // leaves the bookkeeping to the outer call.
+        if (op->starting) {
+            return;
+        }
+        op->starting = true;
+        auto self = this->shared_from_this();
+        while (op->inFlight < op->maxInFlight && op->next < op->targets.size()) {
+            auto i = op->next++;
+            if (mClosing) {
+                op->results[i].ec = boost::asio::error::operation_aborted;
+                op->aborted = true;
+                ++op->done;
+                continue;
+            }
+            auto& target = op->targets[i];
+            auto uri = std::make_shared<::websocketpp::uri>(
+                false, target.host, target.service, "");
+            auto mq = std::make_shared<MessageQueue>(mContext);
+            ++op->inFlight;
+            startConnect(uri, *mq, [op, i, mq, self, this](boost::system::error_code ec) {
+                op->results[i].ec = ec;
+                op->results[i].mq = ec ? nullptr : mq;
+                --op->inFlight;
+                ++op->done;
+                continueConnectMany(op);
+            });
+        }
+        op->starting = false;
+        if (op->done == op->targets.size()) {
+            auto ec = op->aborted
+                ? make_error_code(boost::asio::error::operation_aborted)
+                : boost::system::error_code{};
+            op->handler(ec, std::move(op->results));
+        }
+    }
+
     void handleFail (::websocketpp::connection_hdl hdl) {
         auto ec = boost::system::error_code{};
         auto con = mWsClient.get_con_from_hdl(hdl, ec);
@@ -166,10 +275,17 @@ private:
             auto& mq = data.mq.get();
             mNascentConnections.erase(iter);
             // The newly opened connection has handlers which contain shared_ptrs to this.
-            // Destroy them as soon as possible.
-            mContext.post([con] {
+            // Destroy them as soon as possible. A failed connection never closes, so nothing else
+            // would clear the handlers setConnectionPtr gives it, which keep the MessageQueue, and
+            // through it the connection, alive forever.
+            auto failed = bool(ec);
+            mContext.post([con, failed] {
                 con->set_open_handler(nullptr);
                 con->set_fail_handler(nullptr);
+                if (failed) {
+                    con->set_message_handler(nullptr);
+                    con->set_close_handler(nullptr);
+                }
             });
             mq.setConnectionPtr(con);
             handler(ec);
@@ -186,23 +302,32 @@ private:
         std::function<void(boost::system::error_code)> handler;
         std::reference_wrapper<MessageQueue> mq;
     };
-    std::map<ConnectionPtr, NascentConnectionData> mNascentConnections;
+    std::unordered_map<ConnectionPtr, NascentConnectionData> mNascentConnections;
+    bool mClosing = false;
+    // Touched only on mContext.
 
     mutable util::log::Logger mLog;
 };
 
-class Connector : public util::asio::TransparentIoObject<ConnectorImpl> {
+template <class Config>
+class BasicConnector : public util::asio::TransparentIoObject<BasicConnectorImpl<Config>> {
 public:
-    explicit Connector (boost::asio::io_service& context)
-        : util::asio::TransparentIoObject<ConnectorImpl>(context)
+    explicit BasicConnector (boost::asio::io_service& context)
+        : util::asio::TransparentIoObject<BasicConnectorImpl<Config>>(context)
     {
         this->get_implementation()->init();
     }
 
-    using MessageQueue = ConnectorImpl::MessageQueue;
+    using MessageQueue = typename BasicConnectorImpl<Config>::MessageQueue;
+    using MessageQueuePtr = typename BasicConnectorImpl<Config>::MessageQueuePtr;
+    using ConnectResult = typename BasicConnectorImpl<Config>::ConnectResult;
     UTIL_ASIO_DECL_ASYNC_METHOD(asyncConnect)
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncConnectMany)
 };
 
+using ConnectorImpl = BasicConnectorImpl<ClientConfig>;
+using Connector = BasicConnector<ClientConfig>;
+
 }}} // namespace util::asio::ws
 
 #endif
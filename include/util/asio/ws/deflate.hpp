@@ -0,0 +1,67 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_WS_DEFLATE_HPP
+#define UTIL_ASIO_WS_DEFLATE_HPP
+
+#include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/connector.hpp>
+
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+
+#include <cstdint>
+
+namespace util { namespace asio { namespace ws {
+
+// Opt-in permessage-deflate (RFC 7692) compression. Use `DeflateAcceptor` and `DeflateConnector`
+// in place of `Acceptor` and `Connector`, or apply `WithDeflate` to your own websocketpp config.
+// Compression is negotiated during the handshake, so a deflate endpoint still talks to a peer
+// which does not support it, uncompressed.
+//
+// Messages shorter than `MessageQueue::getMinCompressSize()` are sent uncompressed: for small
+// payloads, deflate's framing overhead costs more than it saves.
+
+struct DefaultDeflateSettings {
+    static constexpr uint8_t maxWindowBits = 15;
+    // Base 2 logarithm of the largest LZ77 window either side may compress with, 9 to 15. Each
+    // connection's compressor needs about 2^(maxWindowBits + 2) bytes plus 128 KiB, and its
+    // decompressor about 2^maxWindowBits bytes, so smaller windows trade ratio for memory.
+
+    static constexpr bool noContextTakeover = false;
+    // If true, reset the compressors after each message. This lets zlib free its window between
+    // messages, at the cost of ratio on streams of similar messages.
+};
+
+template <class Settings>
+class PermessageDeflate
+        : public ::websocketpp::extensions::permessage_deflate::enabled<Settings> {
+    // websocketpp's permessage-deflate extension, configured from `Settings` as each connection
+    // constructs it. The compression level is zlib's default: websocketpp does not expose it.
+
+public:
+    PermessageDeflate () {
+        namespace pmd = ::websocketpp::extensions::permessage_deflate;
+        this->set_server_max_window_bits(Settings::maxWindowBits, pmd::mode::smallest);
+        this->set_client_max_window_bits(Settings::maxWindowBits, pmd::mode::smallest);
+        if (Settings::noContextTakeover) {
+            this->enable_server_no_context_takeover();
+            this->enable_client_no_context_takeover();
+        }
+    }
+};
+
+template <class Base, class Settings = DefaultDeflateSettings>
+struct WithDeflate : public Base {
+    // A websocketpp config identical to `Base`, but with permessage-deflate enabled.
+    typedef WithDeflate type;
+    typedef PermessageDeflate<Settings> permessage_deflate_type;
+};
+
+using DeflateAcceptor = BasicAcceptor<WithDeflate<ServerConfig>>;
+using DeflateConnector = BasicConnector<WithDeflate<ClientConfig>>;
+
+}}} // namespace util::asio::ws
+
+#endif
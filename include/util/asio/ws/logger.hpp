@@ -8,20 +8,25 @@
 
 #include <util/log.hpp>
 
-#include <boost/log/attributes/constant.hpp>
-
 #include <websocketpp/logger/basic.hpp>
 #include <websocketpp/logger/levels.hpp>
 
+#include <atomic>
 #include <ctime>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
 #include <string>
 
 namespace util { namespace asio { namespace ws {
 
 template <typename Concurrency, typename Names>
 class Logger : public ::websocketpp::log::basic<Concurrency, Names> {
+    // A websocketpp logger which writes to Boost.Log. websocketpp calls `write()` for every
+    // message on every channel; disabled channels are rejected by one relaxed atomic load, and
+    // enabled ones go straight to Boost.Log without taking websocketpp's logger mutex. To also
+    // keep formatting and I/O off the calling thread, run with --log-async.
+
 public:
     typedef ::websocketpp::log::basic<Concurrency, Names> base;
     using channel_type_hint = ::websocketpp::log::channel_type_hint;
@@ -29,34 +34,78 @@ public:
 
     Logger (channel_type_hint::value hint = channel_type_hint::access)
         : base(hint)
-    {
-        initSource();
-    }
+    {}
 
     Logger (level channels,
         channel_type_hint::value hint = channel_type_hint::access)
         : base(channels, hint)
-    {
-        initSource();
+    {}
+
+    void set_channels (level channels) {
+        // Hides base::set_channels: websocketpp calls its loggers through their concrete type.
+        std::lock_guard<std::mutex> lock {mChannelsMutex};
+        base::set_channels(channels);
+        updateChannels();
+    }
+
+    void clear_channels (level channels) {
+        std::lock_guard<std::mutex> lock {mChannelsMutex};
+        base::clear_channels(channels);
+        updateChannels();
+    }
+
+    bool dynamic_test (level channel) const {
+        return mChannels.load(std::memory_order_relaxed) & channel;
     }
 
     void write (level channel, const std::string& msg) {
-        write(channel, msg.c_str());
+        if (!dynamic_test(channel)) { return; }
+        log(channel, msg);
     }
 
-    void write(level channel, char const* msg) {
-        scoped_lock_type lock(base::m_lock);
-        if (!this->dynamic_test(channel)) { return; }
-        BOOST_LOG(mLog) << "[" << Names::channel_name(channel) << "] " << msg;
+    void write (level channel, char const* msg) {
+        if (!dynamic_test(channel)) { return; }
+        log(channel, msg);
     }
 
 private:
-    void initSource () {
-        mLog.add_attribute("Protocol", boost::log::attributes::constant<std::string>("WS++"));
+    template <class Message>
+    void log (level channel, const Message& msg) {
+        UTIL_LOG_SEV(mLog, severity(channel, static_cast<Names*>(nullptr)))
+            << "[" << Names::channel_name(channel) << "] " << msg;
     }
 
-    typedef typename base::scoped_lock_type scoped_lock_type;
-    util::log::Logger mLog;
+    void updateChannels () {
+        // Snapshot the base's channel mask, which it only exposes one channel at a time.
+        auto channels = level(0);
+        for (auto i = 0; i < 32; ++i) {
+            auto channel = level(1) << i;
+            if (base::dynamic_test(channel)) {
+                channels |= channel;
+            }
+        }
+        mChannels.store(channels, std::memory_order_relaxed);
+    }
+
+    static util::log::Level severity (level, ::websocketpp::log::alevel*) {
+        return util::log::Level::info;
+    }
+
+    static util::log::Level severity (level channel, ::websocketpp::log::elevel*) {
+        using E = ::websocketpp::log::elevel;
+        return channel & (E::rerror | E::fatal) ? util::log::Level::error
+            : channel & E::warn ? util::log::Level::warning
+            : channel & E::info ? util::log::Level::info
+            : util::log::Level::debug;
+    }
+
+    std::mutex mChannelsMutex;
+    std::atomic<level> mChannels { 0 };
+    // A copy of the base's dynamic channels, readable without its mutex.
+
+    util::log::Logger mLog {util::log::channel = "WS++"};
+    // A channel rather than a Protocol attribute, so --log-filter WS++=<level> can quiet
+    // websocketpp. It renders the same.
 };
 
 }}} // namespace util::asio::ws
@@ -9,13 +9,26 @@
 #include <util/log.hpp>
 
 #include <util/producerconsumerqueue.hpp>
+#include <util/ringqueue.hpp>
 #include <util/asio/asynccompletion.hpp>
+#include <util/asio/bindhandler.hpp>
 #include <util/asio/transparentservice.hpp>
 
 #include <websocketpp/connection.hpp>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace util { namespace asio { namespace ws {
 
@@ -31,10 +44,20 @@ public:
     using ConnectionPtr = typename Connection::ptr;
     using MessagePtr = typename Connection::message_ptr;
 
+    using ReceiveMessageHandlerSignature = void(boost::system::error_code, MessagePtr);
+
+    static constexpr size_t defaultSendBufferLimit = 64 * 1024;
+    static constexpr size_t defaultMinCompressSize = 256;
+
     MessageQueueImpl (boost::asio::io_service& ios)
         : mContext(ios)
+        , mSendTimer(ios)
     {
-        mLog.add_attribute("Protocol", boost::log::attributes::constant<std::string>("WSQ"));
+        // Share one attribute name and value between all queues, rather than taking the attribute
+        // name registry's lock and allocating a new attribute for each one.
+        static const boost::log::attribute_name protocolName {"Protocol"};
+        static const boost::log::attributes::constant<std::string> protocol {"WSQ"};
+        mLog.add_attribute(protocolName, protocol);
     }
 
     ~MessageQueueImpl () {
@@ -42,38 +65,78 @@ public:
             // mPtr's handlers have shared_ptrs back to this, so we need to break the cycle. This
             // shouldn't be done in close() because close() may be called from one of the handlers
             // we're nullifying here.
-            mPtr->set_message_handler(nullptr);
-            mPtr->set_close_handler(nullptr);
+            auto ptr = mPtr;
+            onConnection([ptr] {
+                ptr->set_message_handler(nullptr);
+                ptr->set_close_handler(nullptr);
+            });
         }
+        // No send can be waiting: the send timer's handler would be keeping this alive.
         boost::system::error_code ec;
-        close(ec);
+        closeConnection(ec);
     }
 
     void close (boost::system::error_code& ec) {
-        while (mReceiveQueue.depth() < 0) {
-            mReceiveQueue.produce(boost::asio::error::operation_aborted, nullptr);
-        }
-        while (mReceiveQueue.depth() > 0) {
-            mReceiveQueue.consume([this](boost::system::error_code ec2, MessagePtr msg) {
-                if (!ec2) {
-                    BOOST_LOG(mLog) << "Discarding " << msg->get_payload().size()
-                        << " byte message";
-                }
-                else {
-                    BOOST_LOG(mLog) << "Discarding error message: " << ec2.message();
-                }
-            });
-        }
-        ec = {};
-        if (mPtr) {
-            mPtr->close(websocketpp::close::status::normal, "", ec);
-        }
+        // Sends only wait while the send timer is armed, so cancelling it aborts them all. The
+        // timer belongs to mContext, like everything else the pending sends touch.
+        auto self = this->shared_from_this();
+        mContext.dispatch([self, this] {
+            auto ec2 = boost::system::error_code{};
+            mSendTimer.cancel(ec2);
+        });
+        closeConnection(ec);
     }
 
+    // The getters below read the connection directly. With a single-threaded config, call them
+    // only on mContext's thread.
+
     std::string getRemoteEndpoint () const {
+        checkConfinement();
         return mPtr->get_remote_endpoint();
     }
 
+    std::string getExtensions () const {
+        // The extensions the opening handshake negotiated, as listed by its response's
+        // Sec-WebSocket-Extensions header, e.g., "permessage-deflate". Empty if none.
+        checkConfinement();
+        return mPtr->get_response_header("Sec-WebSocket-Extensions");
+    }
+
+    bool isOpen () const {
+        // True if the connection has completed its handshake and has not begun closing.
+        checkConfinement();
+        return mPtr && mPtr->get_state() == websocketpp::session::state::open;
+    }
+
+    size_t getBufferedAmount () const {
+        // Bytes passed to asyncSend which websocketpp has not yet handed to the socket, including
+        // WebSocket framing. Bytes count as handed over when their write starts, not when it ends.
+        checkConfinement();
+        return mPtr ? mPtr->get_buffered_amount() : 0;
+    }
+
+    size_t getSendBufferLimit () const {
+        return mSendBufferLimit;
+    }
+
+    void setSendBufferLimit (size_t limit) {
+        // asyncSend completes once no more than `limit` bytes are buffered, as counted by
+        // getBufferedAmount(). With a limit of zero, it completes once its frame, and everything
+        // sent before it, has been handed to the socket in an asynchronous write. That write may
+        // still be in progress, so this bounds the memory queued in websocketpp, not in flight.
+        mSendBufferLimit = limit;
+    }
+
+    size_t getMinCompressSize () const {
+        return mMinCompressSize;
+    }
+
+    void setMinCompressSize (size_t size) {
+        // If the connection negotiated permessage-deflate (see deflate.hpp), compress messages of
+        // at least `size` bytes. Smaller messages are sent as is.
+        mMinCompressSize = size;
+    }
+
     template <class CompletionToken>
     BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, SendHandlerSignature)
     asyncSend (boost::asio::const_buffer buffer, CompletionToken&& token) {
@@ -82,10 +145,25 @@ public:
         > init { std::forward<CompletionToken>(token) };
 
         assert(mPtr);
-        auto ec = mPtr->send(boost::asio::buffer_cast<void const*>(buffer),
-                boost::asio::buffer_size(buffer));
-        // Don't know if it's possible to actually detect when the send has completed.
-        mContext.post(std::bind(init.handler, ec));
+        auto size = boost::asio::buffer_size(buffer);
+        auto msg = mPtr->get_message(websocketpp::frame::opcode::binary, size);
+        msg->append_payload(boost::asio::buffer_cast<void const*>(buffer), size);
+        msg->set_compressed(size >= mMinCompressSize);
+
+        auto& handler = init.handler;
+        auto self = this->shared_from_this();
+        onConnection([msg, handler, self, this]() mutable {
+            auto ec = mPtr->send(msg);
+            if (singleThreaded) {
+                // Already on mContext.
+                addPendingSend(std::move(handler), ec);
+            }
+            else {
+                mContext.post([handler, ec, self, this]() mutable {
+                    addPendingSend(std::move(handler), ec);
+                });
+            }
+        });
 
         return init.result.get();
     }
@@ -98,42 +176,294 @@ public:
         > init { std::forward<CompletionToken>(token) };
 
         auto& handler = init.handler;
-        auto self = this->shared_from_this();
-        mContext.post([buffer, handler, self, this]() mutable {
-            auto ec = mPtr->get_transport_ec();
+        consumeMessage([buffer, handler, this]
+                (boost::system::error_code ec, MessagePtr msg) mutable {
+            size_t nCopied = 0;
             if (!ec) {
-                auto consume = [buffer, handler, self, this]
-                        (boost::system::error_code ec2, MessagePtr msg) mutable {
-                    size_t nCopied = 0;
-                    if (!ec2) {
-                        nCopied = boost::asio::buffer_copy(buffer,
-                                boost::asio::buffer(msg->get_payload()));
-                        ec2 = nCopied == msg->get_payload().size()
-                            ? boost::system::error_code()
-                            : make_error_code(boost::asio::error::message_size);
-                    }
-                    mContext.post(std::bind(handler, ec2, nCopied));
-                };
-                mReceiveQueue.consume(consume);
+                nCopied = boost::asio::buffer_copy(buffer,
+                        boost::asio::buffer(msg->get_payload()));
+                ec = nCopied == msg->get_payload().size()
+                    ? boost::system::error_code()
+                    : make_error_code(boost::asio::error::message_size);
             }
-            else {
-                mContext.post(std::bind(handler, ec, 0));
+            mContext.post(util::asio::bindHandler(std::move(handler), ec, nCopied));
+        });
+
+        return init.result.get();
+    }
+
+    template <class Allocator, class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, ReceiveHandlerSignature)
+    asyncReceive (boost::asio::basic_streambuf<Allocator>& streambuf, CompletionToken&& token) {
+        // Append the next message to `streambuf`, growing it as needed. Fails with message_size
+        // only if the message would exceed the streambuf's max_size().
+        util::asio::AsyncCompletion<
+            CompletionToken, ReceiveHandlerSignature
+        > init { std::forward<CompletionToken>(token) };
+
+        auto& handler = init.handler;
+        consumeMessage([&streambuf, handler, this]
+                (boost::system::error_code ec, MessagePtr msg) mutable {
+            size_t nCopied = 0;
+            if (!ec) {
+                auto& payload = msg->get_payload();
+                try {
+                    nCopied = boost::asio::buffer_copy(streambuf.prepare(payload.size()),
+                            boost::asio::buffer(payload));
+                    streambuf.commit(nCopied);
+                }
+                catch (std::length_error&) {
+                    ec = make_error_code(boost::asio::error::message_size);
+                }
             }
+            mContext.post(util::asio::bindHandler(std::move(handler), ec, nCopied));
+        });
+
+        return init.result.get();
+    }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, ReceiveMessageHandlerSignature)
+    asyncReceiveMessage (CompletionToken&& token) {
+        // Hand over the next websocketpp message itself, without copying its payload. The
+        // handler owns the message: it may decode the payload in place, or move it out with
+        // `std::move(msg->get_payload())`. On error, the message pointer is null.
+        util::asio::AsyncCompletion<
+            CompletionToken, ReceiveMessageHandlerSignature
+        > init { std::forward<CompletionToken>(token) };
+
+        auto& handler = init.handler;
+        consumeMessage([handler, this](boost::system::error_code ec, MessagePtr msg) mutable {
+            mContext.post(util::asio::bindHandler(std::move(handler), ec, std::move(msg)));
         });
 
         return init.result.get();
     }
 
     void setConnectionPtr (ConnectionPtr ptr) {
+        // A single-threaded connection is only confined by onConnection if it runs on mContext.
+        assert((!singleThreaded || &ptr->get_raw_socket().get_io_service() == &mContext)
+            && "single-threaded connection on another io_service; see singlethreaded.hpp");
         mPtr = ptr;
         auto self = this->shared_from_this();
         mPtr->set_message_handler(std::bind(&MessageQueueImpl::handleMessage, self, _1, _2));
         mPtr->set_close_handler(std::bind(&MessageQueueImpl::handleClose, self, _1));
     }
 
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, ReceiveHandlerSignature)
+    asyncReceiveSome (std::vector<MessagePtr>& messages, size_t maxMessages,
+            CompletionToken&& token) {
+        // Wait for at least one message, then take every message already queued behind it, up to
+        // `maxMessages` in all. Append them to `messages` and complete with the number appended,
+        // so a burst is handled in one completion. An error is reported only if no messages
+        // precede it; otherwise it is left for the next receive.
+        util::asio::AsyncCompletion<
+            CompletionToken, ReceiveHandlerSignature
+        > init { std::forward<CompletionToken>(token) };
+
+        assert(maxMessages > 0);
+        auto& handler = init.handler;
+        consumeMessage([&messages, maxMessages, handler, this]
+                (boost::system::error_code ec, MessagePtr msg) mutable {
+            size_t n = 0;
+            if (!ec) {
+                messages.push_back(std::move(msg));
+                ++n;
+                // consumeMessage holds mReceiveMutex while we run.
+                while (n < maxMessages) {
+                    auto next = mReceiveQueue.front();
+                    if (!next || std::get<0>(*next)) {
+                        break;
+                    }
+                    mReceiveQueue.tryConsume([&](boost::system::error_code, MessagePtr m) {
+                        messages.push_back(std::move(m));
+                    });
+                    ++n;
+                }
+            }
+            mContext.post(util::asio::bindHandler(std::move(handler), ec, n));
+        });
+
+        return init.result.get();
+    }
+
 private:
+    static constexpr bool singleThreaded = !Config::transport_config::enable_multithreading;
+    // See singlethreaded.hpp. Such connections may only be touched on mContext.
+
+    template <class F>
+    void onConnection (F&& f) {
+        // Run `f`, which touches mPtr, on a thread where that is allowed.
+        if (singleThreaded) {
+            mContext.dispatch(std::forward<F>(f));
+        }
+        else {
+            f();
+        }
+    }
+
+    void checkConfinement () const {
+        // Debug builds: assert that a single-threaded connection stays on one thread.
+#ifndef NDEBUG
+        if (singleThreaded) {
+            auto id = std::this_thread::get_id();
+            auto expected = std::thread::id{};
+            if (!mConnectionThread.compare_exchange_strong(expected, id)) {
+                assert(expected == id && "single-threaded config used from two threads");
+            }
+        }
+#endif
+    }
+
+    void closeConnection (boost::system::error_code& ec) {
+        // Everything close() does but abort pending sends.
+        std::unique_lock<std::mutex> lock {mReceiveMutex};
+        while (mReceiveQueue.depth() < 0) {
+            mReceiveQueue.produce(boost::asio::error::operation_aborted, nullptr);
+        }
+        while (mReceiveQueue.depth() > 0) {
+            mReceiveQueue.consume([this](boost::system::error_code ec2, MessagePtr msg) {
+                if (!ec2) {
+                    BOOST_LOG(mLog) << "Discarding " << msg->get_payload().size()
+                        << " byte message";
+                }
+                else {
+                    BOOST_LOG(mLog) << "Discarding error message: " << ec2.message();
+                }
+            });
+        }
+        lock.unlock();
+        ec = {};
+        if (mPtr && singleThreaded) {
+            // Errors can only be logged: the close happens later, on mContext.
+            auto ptr = mPtr;
+            auto log = mLog;
+            mContext.dispatch([ptr, log]() mutable {
+                auto ec2 = boost::system::error_code{};
+                ptr->close(websocketpp::close::status::normal, "", ec2);
+                if (ec2) {
+                    BOOST_LOG(log) << "Error closing WebSocket connection: " << ec2.message();
+                }
+            });
+        }
+        else if (mPtr) {
+            mPtr->close(websocketpp::close::status::normal, "", ec);
+        }
+    }
+
+    void addPendingSend (std::function<void(boost::system::error_code)> handler,
+            boost::system::error_code ec) {
+        // websocketpp has no per-message completion, so hold the handler until the connection's
+        // buffered amount drops to our limit. Sends complete in order: a send which websocketpp
+        // rejected, with `ec`, completes with that error, but not before the sends ahead of it.
+        checkConfinement();
+        if (ec) {
+            if (mPendingSends.empty()) {
+                mContext.post(std::bind(handler, ec));
+            }
+            else {
+                mPendingSends.emplace([handler, ec](boost::system::error_code) {
+                    handler(ec);
+                });
+            }
+            return;
+        }
+        mPendingSends.emplace(std::move(handler));
+        checkPendingSends();
+    }
+
+    template <class Consumer>
+    void consumeMessage (Consumer&& consumer) {
+        // Call `consumer(ec, msg)` with the next received message, or with the connection's error
+        // and a null message if the transport has failed. If a message is already queued, the
+        // consumer runs before this function returns, with no allocation; otherwise it is saved
+        // and run from handleMessage or handleClose, or by checkTransportError. Either way it runs
+        // under mReceiveMutex, and must post the user's handler rather than invoke it.
+        auto self = this->shared_from_this();
+        {
+            std::lock_guard<std::mutex> lock {mReceiveMutex};
+            if (mReceiveQueue.tryConsume(consumer)) {
+                return;
+            }
+            mReceiveQueue.consume([consumer = std::forward<Consumer>(consumer), self]
+                    (boost::system::error_code ec, MessagePtr msg) mutable {
+                consumer(ec, std::move(msg));
+            });
+        }
+        mContext.dispatch([self, this] { checkTransportError(); });
+    }
+
+    void checkTransportError () {
+        // The transport may have failed before a consumer was saved, in which case handleClose
+        // has already delivered its one error, and nothing else would ever run the consumer. Only
+        // called on mContext, where the connection may be touched.
+        checkConfinement();
+        auto ec = mPtr->get_transport_ec();
+        if (!ec) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock {mReceiveMutex};
+        if (mReceiveQueue.depth() < 0) {
+            mReceiveQueue.produce(ec, nullptr);
+        }
+    }
+
+    void checkPendingSends () {
+        if (mPendingSends.empty()) {
+            return;
+        }
+        auto ec = mPtr->get_transport_ec();
+        auto buffered = mPtr->get_buffered_amount();
+        if (buffered > mSendBufferLimit) {
+            if (!ec && mPtr->get_state() != websocketpp::session::state::closed) {
+                if (!mSendTimerArmed) {
+                    // websocketpp tells no one when its buffer drains, so poll it. Poll quickly
+                    // while the buffer is draining, and back off while it is stuck, e.g., behind a
+                    // peer that is not reading, so idle backpressured connections cost little.
+                    mSendPollInterval = buffered < mLastBufferedAmount
+                        ? minSendPollInterval
+                        : std::min(mSendPollInterval * 2, maxSendPollInterval);
+                    mLastBufferedAmount = buffered;
+                    mSendTimerArmed = true;
+                    mSendTimer.expires_from_now(mSendPollInterval);
+                    auto self = this->shared_from_this();
+                    mSendTimer.async_wait([self, this](boost::system::error_code ec2) {
+                        mSendTimerArmed = false;
+                        if (!ec2) {
+                            checkPendingSends();
+                        }
+                        else {
+                            completePendingSends(ec2);
+                        }
+                    });
+                }
+                return;
+            }
+            // The buffered bytes will never be written.
+            ec = ec ? ec : boost::asio::error::operation_aborted;
+        }
+        completePendingSends(ec);
+    }
+
+    void completePendingSends (boost::system::error_code ec) {
+        mLastBufferedAmount = noBufferedAmount;
+        while (!mPendingSends.empty()) {
+            mContext.post(std::bind(mPendingSends.front(), ec));
+            mPendingSends.pop();
+        }
+    }
+
+    static constexpr std::chrono::milliseconds minSendPollInterval { 1 };
+    static constexpr std::chrono::milliseconds maxSendPollInterval { 128 };
+    // Bounds on how often to recheck the buffered amount while a send is waiting for it to drop.
+
+    static constexpr size_t noBufferedAmount = size_t(-1);
+
     void handleMessage (websocketpp::connection_hdl, MessagePtr msg) {
-        //BOOST_LOG(mLog) << "Received " << msg->get_payload().size();
+        checkConfinement();
+        UTIL_LOG_TRACE(mLog) << "Received " << msg->get_payload().size() << " byte message";
+        std::lock_guard<std::mutex> lock {mReceiveMutex};
         mReceiveQueue.produce(boost::system::error_code(), msg);
     }
 
@@ -143,16 +473,63 @@ private:
             << mPtr->get_remote_close_reason() << "]";
         auto ec = mPtr->get_transport_ec();
         ec = ec ? ec : boost::asio::error::operation_aborted;
-        mReceiveQueue.produce(ec, nullptr);
+        {
+            std::lock_guard<std::mutex> lock {mReceiveMutex};
+            mReceiveQueue.produce(ec, nullptr);
+        }
+        // The connection will not call our handlers again, but they hold shared_ptrs to this, and
+        // we hold mPtr: neither would ever be freed. Release them, though not from inside the
+        // close handler itself. `self` keeps this alive until they are gone.
+        auto ptr = mPtr;
+        auto self = this->shared_from_this();
+        mContext.post([ptr, self] {
+            ptr->set_message_handler(nullptr);
+            ptr->set_close_handler(nullptr);
+        });
     }
 
     boost::asio::io_service& mContext;
     ConnectionPtr mPtr;
+    std::mutex mReceiveMutex;
     util::ProducerConsumerQueue<boost::system::error_code, MessagePtr> mReceiveQueue;
+    // Locked rather than confined to mContext, so asyncReceive can complete a queued message
+    // without first posting to mContext.
+
+    size_t mSendBufferLimit = defaultSendBufferLimit;
+    size_t mMinCompressSize = defaultMinCompressSize;
+    util::RingQueue<std::function<void(boost::system::error_code)>> mPendingSends;
+    boost::asio::steady_timer mSendTimer;
+    std::chrono::milliseconds mSendPollInterval = minSendPollInterval;
+    size_t mLastBufferedAmount = noBufferedAmount;
+    // What the last poll saw, so the next one can tell whether the buffer is draining.
+    bool mSendTimerArmed = false;
+    // Touched only on mContext.
+
+#ifndef NDEBUG
+    mutable std::atomic<std::thread::id> mConnectionThread {};
+#endif
 
     mutable util::log::Logger mLog;
 };
 
+template <class Config>
+constexpr size_t MessageQueueImpl<Config>::defaultSendBufferLimit;
+
+template <class Config>
+constexpr size_t MessageQueueImpl<Config>::defaultMinCompressSize;
+
+template <class Config>
+constexpr bool MessageQueueImpl<Config>::singleThreaded;
+
+template <class Config>
+constexpr std::chrono::milliseconds MessageQueueImpl<Config>::minSendPollInterval;
+
+template <class Config>
+constexpr std::chrono::milliseconds MessageQueueImpl<Config>::maxSendPollInterval;
+
+template <class Config>
+constexpr size_t MessageQueueImpl<Config>::noBufferedAmount;
+
 template <class Config>
 class MessageQueue : public util::asio::TransparentIoObject<MessageQueueImpl<Config>> {
 public:
@@ -161,6 +538,7 @@ public:
     {}
 
     using ConnectionPtr = typename MessageQueueImpl<Config>::ConnectionPtr;
+    using MessagePtr = typename MessageQueueImpl<Config>::MessagePtr;
     void setConnectionPtr (ConnectionPtr ptr) {
         this->get_implementation()->setConnectionPtr(ptr);
     }
@@ -169,8 +547,38 @@ public:
         return this->get_implementation()->getRemoteEndpoint();
     }
 
+    std::string getExtensions () const {
+        return this->get_implementation()->getExtensions();
+    }
+
+    bool isOpen () const {
+        return this->get_implementation()->isOpen();
+    }
+
+    size_t getBufferedAmount () const {
+        return this->get_implementation()->getBufferedAmount();
+    }
+
+    size_t getSendBufferLimit () const {
+        return this->get_implementation()->getSendBufferLimit();
+    }
+
+    void setSendBufferLimit (size_t limit) {
+        this->get_implementation()->setSendBufferLimit(limit);
+    }
+
+    size_t getMinCompressSize () const {
+        return this->get_implementation()->getMinCompressSize();
+    }
+
+    void setMinCompressSize (size_t size) {
+        this->get_implementation()->setMinCompressSize(size);
+    }
+
     UTIL_ASIO_DECL_ASYNC_METHOD(asyncSend)
     UTIL_ASIO_DECL_ASYNC_METHOD(asyncReceive)
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncReceiveMessage)
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncReceiveSome)
 };
 
 }}} // namespace util::asio::ws
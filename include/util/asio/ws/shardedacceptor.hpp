@@ -0,0 +1,420 @@
+// Copyright (c) 2014-2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_WS_SHARDEDACCEPTOR_HPP
+#define UTIL_ASIO_WS_SHARDEDACCEPTOR_HPP
+
+#include <util/log.hpp>
+#include <util/logratelimit.hpp>
+
+#include <util/producerconsumerqueue.hpp>
+#include <util/asio/asynccompletion.hpp>
+#include <util/asio/iothreadpool.hpp>
+#include <util/asio/transparentservice.hpp>
+
+#include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/messagequeue.hpp>
+
+#include <websocketpp/server.hpp>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace util { namespace asio { namespace ws {
+
+class ShardedAcceptorImpl : public std::enable_shared_from_this<ShardedAcceptorImpl> {
+    // Accept WebSocket connections on one listening socket, distributing them across the shards
+    // of an `IoThreadPool`.
+    //
+    // Each shard runs its own `websocketpp::server`, driven by the shard's io_service. The TCP
+    // accept happens on the acceptor's own io_service, but the accepted socket belongs to the
+    // least-loaded shard, and the WebSocket handshake and everything after it runs on that
+    // shard's thread. Accepted connections are delivered as `MessageQueue`s constructed on the
+    // shard's io_service, so they are confined to the shard's thread.
+    //
+    // With `ListenMode::reusePort`, each shard instead opens its own SO_REUSEPORT listening
+    // socket on the same endpoint, and the kernel spreads incoming connections across them. The
+    // TCP accept then also runs on the shard's thread, so no single thread touches every
+    // connection. The kernel, not `IoThreadPool::leastLoaded()`, picks the shard.
+
+public:
+    using Config = AcceptorImpl::Config;
+    using Connection = ::websocketpp::connection<Config>;
+    using ConnectionPtr = Connection::ptr;
+    using MessageQueue = ::util::asio::ws::MessageQueue<Config>;
+    using MessageQueuePtr = std::shared_ptr<MessageQueue>;
+
+    static_assert(Config::transport_config::enable_multithreading,
+        "Connections are accepted on one thread and run on another; see singlethreaded.hpp");
+
+    enum class ListenMode {
+        shared,
+        // One listening socket, accepted on the acceptor's io_service.
+        reusePort
+        // One SO_REUSEPORT listening socket per shard. Throws `boost::system::system_error` with
+        // operation_not_supported on platforms without SO_REUSEPORT.
+    };
+
+    explicit ShardedAcceptorImpl (boost::asio::io_service& ios)
+        : mContext(ios)
+        , mAcceptor(ios)
+        , mRetryTimer(ios)
+    {}
+
+    void init (IoThreadPool& shards) {
+        // Called immediately post-construction, so we have access to shared_from_this().
+        mPool = &shards;
+        auto self = this->shared_from_this();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            mShards.emplace_back(new Shard{shards.context(i)});
+            auto& server = mShards.back()->server;
+            server.init_asio(&shards.context(i));
+            server.set_access_channels(::websocketpp::log::alevel::none);
+            server.set_access_channels(
+                ::websocketpp::log::alevel::connect
+                | ::websocketpp::log::alevel::disconnect
+                | ::websocketpp::log::alevel::http
+                | ::websocketpp::log::alevel::fail
+            );
+            server.set_error_channels(::websocketpp::log::elevel::none);
+            server.set_error_channels(
+                ::websocketpp::log::elevel::info
+                | ::websocketpp::log::elevel::warn
+                | ::websocketpp::log::elevel::rerror
+                | ::websocketpp::log::elevel::fatal
+            );
+            server.set_open_handler(std::bind(&ShardedAcceptorImpl::handleOpen, self, i, _1));
+            server.set_fail_handler(std::bind(&ShardedAcceptorImpl::handleFail, self, i, _1));
+        }
+    }
+
+    void close (boost::system::error_code& ec) {
+        ec = {};
+        auto self = this->shared_from_this();
+        mContext.post([self, this]() mutable {
+            auto ec2 = boost::system::error_code{};
+            mAcceptor.close(ec2);
+            mRetryTimer.cancel(ec2);
+            while (mConnectionQueue.depth() < 0) {
+                mConnectionQueue.produce(boost::asio::error::operation_aborted, nullptr);
+            }
+            while (mConnectionQueue.depth() > 0) {
+                mConnectionQueue.consume([this](boost::system::error_code ec3, MessageQueuePtr mq) {
+                    if (!ec3) {
+                        BOOST_LOG(mLog) << "Discarding accepted connection";
+                        mq->get_io_service().post([mq] {
+                            auto ec4 = boost::system::error_code{};
+                            mq->close(ec4);
+                        });
+                    }
+                    else {
+                        BOOST_LOG(mLog) << "Discarding error message: " << ec3.message();
+                    }
+                });
+            }
+            for (auto& shard : mShards) {
+                // The shards' open and fail handlers hold shared_ptrs to this. Break the cycle on
+                // each shard's own thread.
+                auto& s = *shard;
+                s.context.post([self, &s] {
+                    auto ec4 = boost::system::error_code{};
+                    s.acceptor.close(ec4);
+                    s.retryTimer.cancel(ec4);
+                    s.server.set_open_handler(nullptr);
+                    s.server.set_fail_handler(nullptr);
+                    for (auto&& pending : s.pending) {
+                        auto ec4 = boost::system::error_code{};
+                        pending.first->close(::websocketpp::close::status::going_away, "", ec4);
+                    }
+                    s.pending.clear();
+                });
+            }
+        });
+    }
+
+    void listen (const boost::asio::ip::tcp::endpoint& endpoint,
+            ListenMode mode = ListenMode::shared) {
+        if (mode == ListenMode::shared) {
+            mAcceptor.open(endpoint.protocol());
+            mAcceptor.set_option(boost::asio::socket_base::reuse_address(true));
+            mAcceptor.bind(endpoint);
+            mAcceptor.listen();
+            startAccept();
+            return;
+        }
+#ifdef SO_REUSEPORT
+        using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        auto ep = endpoint;
+        for (auto& shard : mShards) {
+            // The first bind resolves port 0; the rest must join the same port.
+            auto& acceptor = shard->acceptor;
+            acceptor.open(ep.protocol());
+            acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+            acceptor.set_option(ReusePort(true));
+            acceptor.bind(ep);
+            acceptor.listen();
+            ep = acceptor.local_endpoint();
+        }
+        for (size_t i = 0; i < mShards.size(); ++i) {
+            auto self = this->shared_from_this();
+            mShards[i]->context.post([self, this, i] { startShardAccept(i); });
+        }
+#else
+        throw boost::system::system_error(
+            make_error_code(boost::asio::error::operation_not_supported));
+#endif
+    }
+
+    boost::asio::ip::tcp::endpoint getLocalEndpoint () {
+        return mAcceptor.is_open() ? mAcceptor.local_endpoint()
+                                   : mShards.front()->acceptor.local_endpoint();
+    }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+            void(boost::system::error_code, MessageQueuePtr))
+    asyncAccept (CompletionToken&& token) {
+        util::asio::AsyncCompletion<
+            CompletionToken, void(boost::system::error_code, MessageQueuePtr)
+        > init { std::forward<CompletionToken>(token) };
+
+        auto& handler = init.handler;
+        auto self = this->shared_from_this();
+        mContext.post([handler, self, this]() mutable {
+            mConnectionQueue.consume(handler);
+        });
+
+        return init.result.get();
+    }
+
+private:
+    struct Shard {
+        explicit Shard (boost::asio::io_service& ios)
+            : context(ios), acceptor(ios), retryTimer(ios)
+        {}
+
+        boost::asio::io_service& context;
+        ::websocketpp::server<Config> server;
+        boost::asio::ip::tcp::acceptor acceptor;
+        boost::asio::steady_timer retryTimer;
+        // Only used in ListenMode::reusePort.
+        std::map<ConnectionPtr, IoThreadPool::Load> pending;
+        // Connections which have been handed to this shard but have not yet completed their
+        // WebSocket handshake. Only touched on the shard's thread.
+        util::log::Logger log;
+        // Loggers are not thread-safe, so events on the shard's thread are logged here rather
+        // than to mLog.
+    };
+
+    void startAccept () {
+        // Create the connection on the chosen shard's thread, then come back to our own thread
+        // to accept its socket.
+        auto i = mPool->leastLoaded();
+        auto load = std::make_shared<IoThreadPool::Load>(mPool->acquireLoad(i));
+        auto self = this->shared_from_this();
+        auto& s = *mShards[i];
+        s.context.post([self, this, &s, load] {
+            auto con = s.server.get_connection();
+            if (!con) {
+                UTIL_LOG_RATE_LIMITED(s.log, util::log::Level::warning, 1, 5)
+                    << "Shard could not create a connection";
+                load->reset();
+                mContext.post([self, this] { retryAccept(); });
+                return;
+            }
+            s.pending.emplace(con, std::move(*load));
+            mContext.post([self, this, &s, con] {
+                if (!mAcceptor.is_open()) {
+                    s.context.post([self, &s, con] { s.pending.erase(con); });
+                    return;
+                }
+                mAcceptor.async_accept(con->get_raw_socket(),
+                        [self, this, &s, con](boost::system::error_code ec) {
+                    handleAccept(s, con, ec);
+                });
+            });
+        });
+    }
+
+    void startShardAccept (size_t i) {
+        // ListenMode::reusePort's accept loop, entirely on shard i's thread.
+        auto& s = *mShards[i];
+        if (!s.acceptor.is_open()) {
+            return;
+        }
+        auto con = s.server.get_connection();
+        if (!con) {
+            UTIL_LOG_RATE_LIMITED(s.log, util::log::Level::warning, 1, 5)
+                << "Shard could not create a connection";
+            retryShardAccept(i);
+            return;
+        }
+        s.pending.emplace(con, mPool->acquireLoad(i));
+        auto self = this->shared_from_this();
+        s.acceptor.async_accept(con->get_raw_socket(),
+                [self, this, i, con](boost::system::error_code ec) {
+            auto& s = *mShards[i];
+            if (ec) {
+                s.pending.erase(con);
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                UTIL_LOG_RATE_LIMITED(s.log, util::log::Level::warning, 1, 5)
+                    << "Accept failed: " << ec.message();
+                retryShardAccept(i);
+                return;
+            }
+            con->start();
+            startShardAccept(i);
+        });
+    }
+
+    void retryShardAccept (size_t i) {
+        // On shard i's thread, restart its accept loop after acceptRetryDelay().
+        auto& s = *mShards[i];
+        auto self = this->shared_from_this();
+        s.retryTimer.expires_from_now(acceptRetryDelay());
+        s.retryTimer.async_wait([self, this, i](boost::system::error_code ec) {
+            if (!ec) {
+                startShardAccept(i);
+            }
+        });
+    }
+
+    void handleAccept (Shard& s, ConnectionPtr con, const boost::system::error_code& ec) {
+        auto self = this->shared_from_this();
+        if (ec) {
+            s.context.post([self, &s, con] { s.pending.erase(con); });
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            UTIL_LOG_RATE_LIMITED(mLog, util::log::Level::warning, 1, 5)
+                << "Accept failed: " << ec.message();
+            retryAccept();
+            return;
+        }
+        s.context.post([con] { con->start(); });
+        startAccept();
+    }
+
+    void retryAccept () {
+        // On mContext, restart the accept loop after acceptRetryDelay(). E.g., EMFILE fails every
+        // accept until a descriptor frees up, so retrying at once would spin.
+        auto self = this->shared_from_this();
+        mRetryTimer.expires_from_now(acceptRetryDelay());
+        mRetryTimer.async_wait([self, this](boost::system::error_code ec) {
+            if (!ec && mAcceptor.is_open()) {
+                startAccept();
+            }
+        });
+    }
+
+    void handleOpen (size_t i, ::websocketpp::connection_hdl hdl) {
+        // Runs on shard i's thread.
+        auto& s = *mShards[i];
+        auto ec = boost::system::error_code{};
+        auto con = s.server.get_con_from_hdl(hdl, ec);
+        if (ec) {
+            BOOST_LOG(s.log) << "Open handler could not get connection pointer: " << ec.message();
+            return;
+        }
+        auto iter = s.pending.find(con);
+        if (iter == s.pending.end()) {
+            BOOST_LOG(s.log) << "Open handler could not find pending connection";
+            return;
+        }
+        auto load = std::make_shared<IoThreadPool::Load>(std::move(iter->second));
+        s.pending.erase(iter);
+
+        auto self = this->shared_from_this();
+        s.context.post([con] {
+            // The open and fail handlers hold pointers to the acceptor object. Kill them before
+            // we let them escape.
+            con->set_open_handler(nullptr);
+            con->set_fail_handler(nullptr);
+        });
+
+        // The queue's deleter releases the shard's load when the user is done with it.
+        auto mq = MessageQueuePtr(new MessageQueue{s.context}, [load](MessageQueue* p) {
+            delete p;
+        });
+        mq->setConnectionPtr(con);
+        mContext.post([self, this, mq] {
+            mConnectionQueue.produce(boost::system::error_code{}, mq);
+        });
+    }
+
+    void handleFail (size_t i, ::websocketpp::connection_hdl hdl) {
+        // Runs on shard i's thread.
+        auto& s = *mShards[i];
+        auto ec = boost::system::error_code{};
+        auto con = s.server.get_con_from_hdl(hdl, ec);
+        if (ec) {
+            BOOST_LOG(s.log) << "Fail handler could not get connection pointer: " << ec.message();
+            return;
+        }
+        s.pending.erase(con);
+        ec = con->get_transport_ec();
+        ec = ec ? ec : make_error_code(boost::asio::error::network_down);
+        auto self = this->shared_from_this();
+        mContext.post([self, this, ec] {
+            mConnectionQueue.produce(ec, nullptr);
+        });
+    }
+
+    static std::chrono::milliseconds acceptRetryDelay () {
+        // How long to wait after an accept fails, other than by being cancelled, before the next.
+        return std::chrono::milliseconds{100};
+    }
+
+    boost::asio::io_service& mContext;
+    boost::asio::ip::tcp::acceptor mAcceptor;
+    boost::asio::steady_timer mRetryTimer;
+    IoThreadPool* mPool = nullptr;
+    std::vector<std::unique_ptr<Shard>> mShards;
+    util::ProducerConsumerQueue<boost::system::error_code, MessageQueuePtr> mConnectionQueue;
+    // Only touched on mContext's thread.
+
+    mutable util::log::Logger mLog;
+    // Only used on mContext's thread; see Shard::log.
+};
+
+class ShardedAcceptor : public util::asio::TransparentIoObject<ShardedAcceptorImpl> {
+    // Like `Acceptor`, but connections are accepted onto the shards of an `IoThreadPool`. The
+    // completion signature of `asyncAccept` is `void(error_code, MessageQueuePtr)`: the acceptor,
+    // not the caller, chooses which io_service the `MessageQueue` is constructed on. The pool
+    // must outlive the acceptor.
+
+public:
+    ShardedAcceptor (boost::asio::io_service& ios, IoThreadPool& shards)
+        : util::asio::TransparentIoObject<ShardedAcceptorImpl>(ios)
+    {
+        this->get_implementation()->init(shards);
+    }
+
+    using ListenMode = ShardedAcceptorImpl::ListenMode;
+
+    void listen (const boost::asio::ip::tcp::endpoint& ep, ListenMode mode = ListenMode::shared) {
+        this->get_implementation()->listen(ep, mode);
+    }
+
+    boost::asio::ip::tcp::endpoint getLocalEndpoint () {
+        return this->get_implementation()->getLocalEndpoint();
+    }
+
+    using MessageQueue = ShardedAcceptorImpl::MessageQueue;
+    using MessageQueuePtr = ShardedAcceptorImpl::MessageQueuePtr;
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncAccept)
+};
+
+}}} // namespace util::asio::ws
+
+#endif
@@ -0,0 +1,58 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_ASIO_WS_SINGLETHREADED_HPP
+#define UTIL_ASIO_WS_SINGLETHREADED_HPP
+
+#include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/logger.hpp>
+
+#include <websocketpp/concurrency/none.hpp>
+#include <websocketpp/transport/asio/endpoint.hpp>
+
+namespace util { namespace asio { namespace ws {
+
+// websocketpp configs for endpoints whose io_service is run by exactly one thread, e.g., an
+// `IoThread` or one shard of an `IoThreadPool`. websocketpp's default asio configs lock a mutex on
+// every connection operation and log call, and wrap every transport handler in a strand; these
+// configs do neither. `MessageQueue` hops onto its io_service before touching a single-threaded
+// connection, so its operations may still be initiated from any thread. The exceptions are its
+// getters, `getRemoteEndpoint`, `getExtensions`, `isOpen` and `getBufferedAmount`, which read the
+// connection directly and must be called on the io_service's thread.
+//
+// Hopping onto the `MessageQueue`'s io_service only confines the connection if that is also the
+// io_service running the connection, i.e., the one its `Acceptor` or `Connector` was constructed
+// on. Nothing else ties the two together, so construct the `MessageQueue` on the same io_service.
+// Debug builds assert this when the connection is handed to the `MessageQueue`.
+//
+// Running the io_service on more than one thread is undefined behavior. Debug builds assert that
+// each `MessageQueue`'s connection is only ever touched from one thread.
+
+template <class Base>
+struct SingleThreaded : public Base {
+    // A websocketpp config identical to `Base`, but without locks or strands.
+    typedef SingleThreaded type;
+    typedef ::websocketpp::concurrency::none concurrency_type;
+
+    typedef Logger<concurrency_type, ::websocketpp::log::elevel> elog_type;
+    typedef Logger<concurrency_type, ::websocketpp::log::alevel> alog_type;
+
+    struct transport_config : public Base::transport_config {
+        typedef typename type::concurrency_type concurrency_type;
+        typedef typename type::alog_type alog_type;
+        typedef typename type::elog_type elog_type;
+        static const bool enable_multithreading = false;
+    };
+
+    typedef ::websocketpp::transport::asio::endpoint<transport_config> transport_type;
+};
+
+using SingleThreadedAcceptor = BasicAcceptor<SingleThreaded<ServerConfig>>;
+using SingleThreadedConnector = BasicConnector<SingleThreaded<ClientConfig>>;
+
+}}} // namespace util::asio::ws
+
+#endif
@@ -0,0 +1,106 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_BINARYLOG_HPP
+#define UTIL_BINARYLOG_HPP
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace util { namespace log { namespace binary {
+
+// Compact log file format written by --log-binary-file. Formatting costs nothing on the logging
+// path: the sink writes the raw timestamp, severity, and message, and refers to the string
+// attributes `defaultFormatter()` knows about by interned IDs. `Decoder` (and the
+// cxx-util-logdecode tool) renders the file back to the text format of the other sinks.
+//
+// A file is the 8-byte `magic` followed by frames. Each frame is a little-endian uint32 length,
+// then that many bytes of payload, whose first byte is a `FrameType`:
+//
+//   string:  uint32 id, then the string's bytes. Defines (or redefines) an interned string.
+//   record:  int64 microseconds since 1970-01-01 in local time, int32 severity, uint8 attribute
+//            count, then that many (uint8 `Attribute`, uint32 string id) pairs, then the message
+//            bytes.
+
+constexpr char magic[8] = { 'C', 'X', 'X', 'U', 'L', 'O', 'G', '1' };
+
+constexpr size_t maxFrameSize = 16 * 1024 * 1024;
+// `Encoder` truncates messages and strings to fit, and `Decoder` treats a longer frame as corruption.
+
+enum class FrameType : uint8_t {
+    string = 0,
+    record = 1
+};
+
+enum class Attribute : uint8_t {
+    // In the order `defaultFormatter()` renders them.
+    channel,
+    role,
+    protocol,
+    devicePath,
+    remoteEndpoint,
+    serialId,
+    requestId
+};
+
+constexpr size_t attributeCount = 7;
+
+const char* attributeName (Attribute);
+// The Boost.Log attribute name, e.g., "RemoteEndpoint".
+
+struct Record {
+    int64_t timestamp = 0;
+    int severity = 0;
+    std::array<const std::string*, attributeCount> attributes {};
+    // Null if the record has no such attribute.
+    const std::string* message = nullptr;
+};
+
+class Encoder {
+    // Serialize records, emitting a string frame the first time each attribute value is seen.
+
+public:
+    static constexpr size_t maxInternedStrings = 4096;
+    // When a record's new values would overflow the table, it is cleared and IDs are reused,
+    // before any of the record's values are interned. Values like RequestId are unbounded, so
+    // the table must not grow forever.
+
+    void writeHeader (std::ostream&);
+    void encode (std::ostream&, const Record&);
+
+private:
+    uint32_t intern (std::ostream&, const std::string&);
+
+    std::unordered_map<std::string, uint32_t> mStrings;
+    std::vector<char> mFrame;
+};
+
+class Decoder {
+    // Read a binary log file and render its records as text. Throws std::runtime_error if the
+    // stream is not a binary log or is corrupt.
+
+public:
+    explicit Decoder (std::istream&);
+
+    bool next (std::ostream& out);
+    // Write the next record as one line of text, in the format of `defaultFormatter()`. Return
+    // false at the end of the stream. A truncated final frame, as left by a crash, counts as the
+    // end of the stream.
+
+private:
+    bool readFrame ();
+
+    std::istream& mIn;
+    std::vector<char> mFrame;
+    std::unordered_map<uint32_t, std::string> mStrings;
+};
+
+}}} // namespace util::log::binary
+
+#endif
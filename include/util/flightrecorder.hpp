@@ -0,0 +1,90 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_FLIGHTRECORDER_HPP
+#define UTIL_FLIGHTRECORDER_HPP
+
+#include <util/log.hpp>
+
+#include <boost/log/core/record_view.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace util { namespace log {
+
+class FlightRecorderBackend
+        : public boost::log::sinks::basic_sink_backend<boost::log::sinks::concurrent_feeding> {
+    // A Boost.Log sink backend which remembers the last `recordsPerThread` records logged by each
+    // thread, and writes them to a file on demand. Use it with an `unlocked_sink` frontend:
+    // each thread writes only its own ring buffer, so recording a record takes no locks, no
+    // allocations, and no formatting. Messages and channel names longer than a ring slot are
+    // truncated.
+    //
+    // `optionsDescription()` installs one with --log-flight-recorder, and then applies the log
+    // levels per sink rather than in the core, so the recorder keeps every record, including those
+    // below --log-level which the other sinks drop. Dumps happen on
+    // `dumpFlightRecorder()`, when a record at or above the trigger level is consumed, and, if
+    // `handleFatalSignals()` has been called, on SIGSEGV, SIGABRT, SIGBUS, SIGILL, or SIGFPE.
+    // Only the first trigger-level record dumps: the trigger stays latched until the next
+    // `dump()`, so a burst of errors costs the logging thread one dump, not one per record.
+
+public:
+    FlightRecorderBackend (std::string dumpPath, size_t recordsPerThread, Level trigger);
+    ~FlightRecorderBackend ();
+
+    static constexpr Level noTrigger = static_cast<Level>(1000);
+
+    void consume (const boost::log::record_view&);
+
+    bool dump (const char* reason) const;
+    // Write all rings to the dump file, oldest record first within each thread, and re-arm the
+    // trigger. Return false if the file could not be written or another dump is in progress. Only
+    // async-signal-safe functions are used, so this may be called from a signal handler.
+
+    void handleFatalSignals ();
+    // Dump from this backend when the process receives a fatal signal, then pass the signal on to
+    // the handler it had before, which is usually its default action. Only one backend at a time
+    // handles signals. The destructor of that backend restores the previous handlers.
+
+    struct Ring;
+
+private:
+    Ring* ring ();
+    bool write (const char* reason) const;
+
+    static constexpr size_t maxRings = 256;
+    // After this many threads have logged, rings of exited threads are reused. Beyond this many
+    // live threads, records are not kept.
+
+    const std::string mDumpPath;
+    const size_t mRecordsPerThread;
+    const int mTrigger;
+    const uint64_t mId;
+
+    std::mutex mMutex;
+    std::vector<std::shared_ptr<Ring>> mOwnedRings;
+    // Guarded by mMutex, touched only when a thread first logs.
+    std::atomic<Ring*> mRings[maxRings];
+    std::atomic<size_t> mRingCount { 0 };
+    // A lock-free view of mOwnedRings for `dump()`.
+
+    mutable std::atomic_flag mDumping = ATOMIC_FLAG_INIT;
+    mutable std::atomic<bool> mTriggered { false };
+    // Set by the first trigger-level record, cleared by `dump()`.
+};
+
+bool dumpFlightRecorder ();
+// Dump the flight recorder installed by --log-flight-recorder. Return false if there is none, or
+// if the dump failed.
+
+}} // namespace util::log
+
+#endif
@@ -7,6 +7,7 @@
 #define UTIL_LOG_HPP
 
 #include <boost/log/attributes/constant.hpp>
+#include <boost/log/expressions/formatter.hpp>
 #include <boost/log/keywords/channel.hpp>
 #include <boost/log/sources/severity_channel_logger.hpp>
 #include <boost/log/sources/record_ostream.hpp>
@@ -16,8 +17,12 @@
 
 #include <boost/optional.hpp>
 
+#include <atomic>
+#include <map>
 #include <string>
 
+#include <cstdint>
+
 namespace util { namespace log {
 
 enum class ConsoleDefault : bool { OFF, ON };
@@ -29,11 +34,118 @@ boost::program_options::options_description optionsDescription (
 // boost::program_options::notify() is called.
 //
 // This function also adds some common attributes to the logging core.
+//
+// With --log-async=1, each sink formats and writes records on its own thread, fed by a bounded
+// queue. --log-async-overflow chooses whether a full queue blocks the logging thread or drops the
+// record; dropped records are counted by `droppedRecords()` and periodically reported.
+//
+// --log-rotate-size and --log-rotate-interval rotate the --log-file in-process. Rotated files are
+// gzipped next to the log file on a background thread, keeping at most --log-max-files of them.
+//
+// --log-binary-file writes records in the compact format described in util/binarylog.hpp, which
+// skips formatting on the logging path. Render it with the cxx-util-logdecode tool.
+//
+// --log-flight-recorder keeps the last records of each thread in memory (see
+// util/flightrecorder.hpp) and writes them to a file on a fatal signal, at a trigger level, or on
+// `dumpFlightRecorder()`. It keeps records at every level: while it is installed, UTIL_LOG_* call
+// sites open a record whatever the level, and only the other sinks filter by level.
+
+boost::log::formatter defaultFormatter ();
+// The formatter used by the text sinks.
+
+uint64_t droppedRecords ();
+// Number of log records discarded because an asynchronous sink's queue was full.
 
 using Logger = boost::log::sources::severity_channel_logger<>;
 
 using boost::log::keywords::channel;
 
+enum class Level : int {
+    // Severity levels for the UTIL_LOG_* macros below. Logger's severity type is a plain int, and
+    // records made with BOOST_LOG() get severity 0, so `info` is 0: existing call sites log at
+    // `info`.
+    trace = -2,
+    debug = -1,
+    info = 0,
+    warning = 1,
+    error = 2,
+    fatal = 3
+};
+
+void setLevel (Level);
+// Set the minimum level which UTIL_LOG_* call sites will emit, for channels without a level of
+// their own. The default is `trace`, i.e., no filtering. Once `optionsDescription()` has been
+// called, the level applies to all records, including those made with BOOST_LOG().
+
+void setChannelLevel (const std::string& channel, Level);
+// Override the minimum level for one channel.
+
+void clearChannelLevels ();
+
+boost::program_options::options_description levelOptionsDescription ();
+// The --log-level and --log-filter options, which `optionsDescription()` also includes. They set
+// the same levels as `setLevel()` and `setChannelLevel()`, and since `optionsDescription()`
+// installs a core filter on those levels, they apply to every record, not just UTIL_LOG_* call
+// sites. The options replace all levels whenever they are notified, and notifying them does not
+// touch the sinks, so re-reading a config file with this description is a way to change levels
+// at run time, e.g., from a boost::asio::signal_set waiting for SIGHUP:
+//   po::variables_map vm;
+//   po::store(po::parse_config_file<char>(path, util::log::levelOptionsDescription()), vm);
+//   po::notify(vm);
+
+Level parseLevel (const std::string&);
+// Parse a level name, e.g., "warning". Throws std::invalid_argument.
+
+namespace _ {
+    extern std::atomic<int> gMinLevel;
+    extern std::atomic<bool> gHaveChannelLevels;
+    extern std::atomic<bool> gRecordAllLevels;
+    bool channelEnabled (const Logger& lg, int level);
+    bool levelEnabled (const std::string& channel, int level);
+    void setChannelLevels (std::map<std::string, int>);
+} // _
+
+inline bool enabled (const Logger& lg, Level level) {
+    // Runtime check performed by UTIL_LOG_* before a record is opened. Without per-channel
+    // overrides, this is a single relaxed atomic load. With them, it is a map lookup on the
+    // logger's channel name, in a snapshot of the levels which takes no lock to read.
+    auto l = static_cast<int>(level);
+    if (_::gRecordAllLevels.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    if (!_::gHaveChannelLevels.load(std::memory_order_relaxed)) {
+        return l >= _::gMinLevel.load(std::memory_order_relaxed);
+    }
+    return _::channelEnabled(lg, l);
+}
+
 }} // namespace util::log
 
+// Compile-time minimum level. UTIL_LOG_* call sites below this level compile to nothing. Define it
+// to the integer value of a `util::log::Level` (e.g., -DUTIL_LOG_MIN_LEVEL=0 for `info`) to
+// override the default, which is `info` in NDEBUG builds and `trace` otherwise.
+#ifndef UTIL_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define UTIL_LOG_MIN_LEVEL 0
+#else
+#define UTIL_LOG_MIN_LEVEL -2
+#endif
+#endif
+
+// Severity-aware replacements for BOOST_LOG(lg). The level is checked at compile time against
+// UTIL_LOG_MIN_LEVEL, then at run time with util::log::enabled(), before the record is opened, so
+// neither the record nor the streamed arguments cost anything when filtered. Note that `lg` is
+// evaluated twice.
+//   UTIL_LOG_TRACE(mLog) << "Received " << n << " bytes";
+#define UTIL_LOG_SEV(lg, lvl) \
+    if (!(static_cast<int>(lvl) >= UTIL_LOG_MIN_LEVEL && ::util::log::enabled((lg), (lvl)))) {} \
+    else BOOST_LOG_SEV(lg, static_cast<int>(lvl))
+
+#define UTIL_LOG_TRACE(lg) UTIL_LOG_SEV(lg, ::util::log::Level::trace)
+#define UTIL_LOG_DEBUG(lg) UTIL_LOG_SEV(lg, ::util::log::Level::debug)
+#define UTIL_LOG_INFO(lg) UTIL_LOG_SEV(lg, ::util::log::Level::info)
+#define UTIL_LOG_WARNING(lg) UTIL_LOG_SEV(lg, ::util::log::Level::warning)
+#define UTIL_LOG_ERROR(lg) UTIL_LOG_SEV(lg, ::util::log::Level::error)
+#define UTIL_LOG_FATAL(lg) UTIL_LOG_SEV(lg, ::util::log::Level::fatal)
+
 #endif
@@ -0,0 +1,130 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_LOGRATELIMIT_HPP
+#define UTIL_LOGRATELIMIT_HPP
+
+#include <util/log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace util { namespace log {
+
+class RateLimit {
+    // A token bucket for log records. Up to `burst` records are admitted at once, refilled at
+    // `perSecond` records per second. Records which are not admitted are counted, and the next
+    // admitted record is preceded by a "Suppressed N similar messages" record on the same logger.
+    // If no record is admitted after a burst, the destructor logs the summary instead, on a new
+    // logger with the channel of the first suppressed record. For a call site's RateLimit, that
+    // happens at exit.
+    //
+    // Usually a RateLimit lives at a call site, via UTIL_LOG_RATE_LIMITED() below. Give an object
+    // its own RateLimit and use UTIL_LOG_LIMITED_BY() to limit per object instead.
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimit (double perSecond, unsigned burst)
+        : mPerSecond(perSecond)
+        , mBurst(std::max(burst, 1u))
+        , mTokens(mBurst)
+    {}
+
+    ~RateLimit () {
+        if (!mSuppressed) {
+            return;
+        }
+        try {
+            Logger lg {channel = mChannel};
+            BOOST_LOG_SEV(lg, static_cast<int>(mLevel))
+                << "Suppressed " << mSuppressed << " similar messages";
+        }
+        catch (...) {}
+    }
+
+    RateLimit (const RateLimit&) = delete;
+    RateLimit& operator= (const RateLimit&) = delete;
+
+    template <class Logger>
+    bool admit (Logger& lg, Level level) {
+        auto suppressed = uint64_t(0);
+        {
+            std::lock_guard<std::mutex> lock {mMutex};
+            auto now = Clock::now();
+            auto elapsed = std::chrono::duration<double>(now - mLastRefill).count();
+            mTokens = std::min(double(mBurst), mTokens + elapsed * mPerSecond);
+            mLastRefill = now;
+            if (mTokens < 1) {
+                if (!mSuppressed++) {
+                    // Once per burst, in case the destructor has to log the summary.
+                    mChannel = channelOf(lg, 0);
+                    mLevel = level;
+                }
+                ++mTotalSuppressed;
+                return false;
+            }
+            mTokens -= 1;
+            suppressed = mSuppressed;
+            mSuppressed = 0;
+        }
+        if (suppressed) {
+            BOOST_LOG_SEV(lg, static_cast<int>(level))
+                << "Suppressed " << suppressed << " similar messages";
+        }
+        return true;
+    }
+
+    uint64_t totalSuppressed () const {
+        std::lock_guard<std::mutex> lock {mMutex};
+        return mTotalSuppressed;
+    }
+
+private:
+    template <class L>
+    static auto channelOf (const L& lg, int) -> decltype(std::string(lg.channel())) {
+        return lg.channel();
+    }
+
+    template <class L>
+    static std::string channelOf (const L&, long) {
+        return {};
+    }
+
+    mutable std::mutex mMutex;
+    const double mPerSecond;
+    const unsigned mBurst;
+    double mTokens;
+    Clock::time_point mLastRefill = Clock::now();
+    uint64_t mSuppressed = 0;
+    uint64_t mTotalSuppressed = 0;
+    std::string mChannel;
+    Level mLevel = Level::info;
+    // Of the first record suppressed since the last summary.
+};
+
+}} // namespace util::log
+
+// Like UTIL_LOG_SEV(lg, lvl), but the record is emitted only if `limit`, a util::log::RateLimit,
+// admits it. The level filter runs first, so filtered records do not consume tokens.
+#define UTIL_LOG_LIMITED_BY(limit, lg, lvl) \
+    if (!(static_cast<int>(lvl) >= UTIL_LOG_MIN_LEVEL && ::util::log::enabled((lg), (lvl)))) {} \
+    else if (!(limit).admit((lg), (lvl))) {} \
+    else BOOST_LOG_SEV(lg, static_cast<int>(lvl))
+
+// Rate limit a call site: each expansion gets its own RateLimit (in templates, one per
+// instantiation). `perSecond` and `burst` must be constant expressions. For example, in a retry
+// loop:
+//   UTIL_LOG_RATE_LIMITED(op.log(), util::log::Level::info, 1, 5) << "asyncOpen: " << ec.message();
+#define UTIL_LOG_RATE_LIMITED(lg, lvl, perSecond, burst) \
+    UTIL_LOG_LIMITED_BY(([]() -> ::util::log::RateLimit& { \
+        static ::util::log::RateLimit limit {(perSecond), (burst)}; \
+        return limit; \
+    }()), lg, lvl)
+
+#endif
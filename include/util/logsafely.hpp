@@ -28,10 +28,23 @@ namespace util {
 struct LogSafely;
 using FormatStream = boost::log::formatting_ostream;
 
+namespace _ {
+
+inline char* writeDigits (char* p, unsigned value, int width) {
+    // Write `value` as exactly `width` zero-padded decimal digits, and return the end.
+    for (auto i = width - 1; i >= 0; --i) {
+        p[i] = char('0' + value % 10);
+        value /= 10;
+    }
+    return p + width;
+}
+
+} // _
+
 using TimerValueType = boost::log::attributes::timer::value_type;
 using SafeTimerToLogManip = boost::log::to_log_manip<TimerValueType, LogSafely>;
 
-FormatStream& operator<< (FormatStream& os, const SafeTimerToLogManip& manip) {
+inline FormatStream& operator<< (FormatStream& os, const SafeTimerToLogManip& manip) {
     auto& t = manip.get();
     os << std::setfill('0')
        << std::setw(2) << t.hours() << ":"
@@ -44,14 +57,39 @@ FormatStream& operator<< (FormatStream& os, const SafeTimerToLogManip& manip) {
 using LocalClockValueType = boost::log::attributes::local_clock::value_type;
 using SafeLocalClockToLogManip = boost::log::to_log_manip<LocalClockValueType, LogSafely>;
 
-FormatStream& operator<< (FormatStream& os, const SafeLocalClockToLogManip& manip) {
-	auto& t = manip.get();
-	os << std::setfill('0')
-	   << std::setw(4) << t.date().year() << '-'
-	   << std::setw(2) << int(t.date().month()) << '-'
-	   << std::setw(2) << t.date().day() << 'T'
-	   << SafeTimerToLogManip{t.time_of_day()};
-   return os;
+inline FormatStream& operator<< (FormatStream& os, const SafeLocalClockToLogManip& manip) {
+    // Timestamps of consecutive records on a thread usually share their second, so each thread
+    // caches the "YYYY-MM-DDTHH:MM:SS." prefix, and only the microseconds are formatted per
+    // record.
+    struct Cache {
+        long long second = -1;
+        char text[26];  // YYYY-MM-DDTHH:MM:SS.ffffff
+    };
+    static thread_local Cache cache;
+
+    auto& t = manip.get();
+    auto tod = t.time_of_day();
+    auto second = (long long)t.date().day_number() * 86400 + tod.total_seconds();
+    if (second != cache.second) {
+        auto ymd = t.date().year_month_day();
+        auto p = cache.text;
+        p = _::writeDigits(p, ymd.year, 4);
+        *p++ = '-';
+        p = _::writeDigits(p, ymd.month, 2);
+        *p++ = '-';
+        p = _::writeDigits(p, ymd.day, 2);
+        *p++ = 'T';
+        p = _::writeDigits(p, unsigned(tod.hours()), 2);
+        *p++ = ':';
+        p = _::writeDigits(p, unsigned(tod.minutes()), 2);
+        *p++ = ':';
+        p = _::writeDigits(p, unsigned(tod.seconds()), 2);
+        *p++ = '.';
+        cache.second = second;
+    }
+    _::writeDigits(cache.text + 20, unsigned(tod.fractional_seconds()), 6);
+    os.write(cache.text, sizeof(cache.text));
+    return os;
 }
 
 } // namespace util
@@ -7,9 +7,9 @@
 #define UTIL_PRODUCERCONSUMERQUEUE_HPP
 
 #include <util/applytuple.hpp>
+#include <util/ringqueue.hpp>
 
 #include <functional>
-#include <queue>
 #include <tuple>
 #include <utility>
 
@@ -28,6 +28,25 @@ public:
         post();
     }
 
+    template <class H>
+    bool tryConsume (H&& handler) {
+        // If data are in the buffer, immediately invoke the function object with the oldest and
+        // return true. Otherwise, return false without saving the function object. Unlike
+        // consume, this never needs to type-erase (and allocate) the function object.
+        if (mData.empty()) {
+            return false;
+        }
+        auto result = std::move(mData.front());
+        mData.pop();
+        util::applyTuple(std::forward<H>(handler), std::move(result));
+        return true;
+    }
+
+    const std::tuple<Data...>* front () const {
+        // The oldest data in the buffer, or null if there are none.
+        return mData.empty() ? nullptr : &mData.front();
+    }
+
     template <class... Ds>
     void produce (Ds&&... data) {
         // Enqueue data to be called as arguments to a pulling function object. If produce is called
@@ -49,19 +68,20 @@ public:
 private:
     void post () {
         while (mHandlers.size() && mData.size()) {
-            auto handler = mHandlers.front();
-            auto result = mData.front();
+            auto handler = std::move(mHandlers.front());
+            auto result = std::move(mData.front());
             mHandlers.pop();
             mData.pop();
-            util::applyTuple(handler, result);
+            util::applyTuple(handler, std::move(result));
         }
     }
 
     using Handler = std::function<void(Data...)>;
     using DataTuple = std::tuple<Data...>;
 
-    std::queue<Handler> mHandlers;
-    std::queue<DataTuple> mData;
+    RingQueue<Handler> mHandlers;
+    RingQueue<DataTuple> mData;
+    // Not std::queue: an idle ProducerConsumerQueue should not own any memory.
 };
 
 } // namespace util
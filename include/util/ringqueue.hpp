@@ -0,0 +1,119 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_RINGQUEUE_HPP
+#define UTIL_RINGQUEUE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace util {
+
+template <class T>
+class RingQueue {
+    // A FIFO queue in one growable power-of-two ring buffer, with std::queue's interface. Unlike
+    // std::deque, which allocates its map and first block on construction (over 500 bytes in
+    // libstdc++), an empty RingQueue which has never held an element owns no memory, so idle
+    // objects with a few queues each stay small. Capacity doubles as needed and is kept until the
+    // queue is destroyed. T's move constructor must not throw.
+
+public:
+    RingQueue () = default;
+
+    RingQueue (RingQueue&& other) noexcept
+        : mData(other.mData)
+        , mHead(other.mHead)
+        , mSize(other.mSize)
+        , mCapacity(other.mCapacity)
+    {
+        other.mData = nullptr;
+        other.mHead = other.mSize = other.mCapacity = 0;
+    }
+
+    RingQueue& operator= (RingQueue&& other) noexcept {
+        // Our old elements are destroyed with `old`.
+        RingQueue old {std::move(other)};
+        std::swap(mData, old.mData);
+        std::swap(mHead, old.mHead);
+        std::swap(mSize, old.mSize);
+        std::swap(mCapacity, old.mCapacity);
+        return *this;
+    }
+
+    RingQueue (const RingQueue&) = delete;
+    RingQueue& operator= (const RingQueue&) = delete;
+
+    ~RingQueue () {
+        while (!empty()) {
+            pop();
+        }
+        ::operator delete(mData);
+    }
+
+    bool empty () const { return !mSize; }
+    size_t size () const { return mSize; }
+    size_t capacity () const { return mCapacity; }
+
+    T& front () {
+        assert(!empty());
+        return mData[mHead];
+    }
+
+    const T& front () const {
+        assert(!empty());
+        return mData[mHead];
+    }
+
+    template <class... Args>
+    void emplace (Args&&... args) {
+        if (mSize == mCapacity) {
+            grow();
+        }
+        new (&mData[(mHead + mSize) & (mCapacity - 1)]) T(std::forward<Args>(args)...);
+        ++mSize;
+    }
+
+    void push (const T& value) { emplace(value); }
+    void push (T&& value) { emplace(std::move(value)); }
+
+    void pop () {
+        assert(!empty());
+        mData[mHead].~T();
+        mHead = (mHead + 1) & (mCapacity - 1);
+        --mSize;
+    }
+
+private:
+    void grow () {
+        auto capacity = mCapacity ? 2 * mCapacity : initialCapacity;
+        auto data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0; i < mSize; ++i) {
+            auto& element = mData[(mHead + i) & (mCapacity - 1)];
+            new (&data[i]) T(std::move(element));
+            element.~T();
+        }
+        ::operator delete(mData);
+        mData = data;
+        mHead = 0;
+        mCapacity = capacity;
+    }
+
+    static constexpr size_t initialCapacity = 4;
+
+    T* mData = nullptr;
+    size_t mHead = 0;
+    size_t mSize = 0;
+    size_t mCapacity = 0;
+    // mCapacity is zero or a power of two.
+};
+
+template <class T>
+constexpr size_t RingQueue<T>::initialCapacity;
+
+} // namespace util
+
+#endif
@@ -0,0 +1,213 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/binarylog.hpp>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace util { namespace log { namespace binary {
+
+namespace {
+
+template <class T>
+void put (std::vector<char>& buf, T value) {
+    // Little-endian, regardless of host byte order.
+    using U = std::make_unsigned_t<T>;
+    auto u = static_cast<U>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        buf.push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+    }
+}
+
+template <class T>
+T get (const char*& p, const char* end) {
+    using U = std::make_unsigned_t<T>;
+    if (size_t(end - p) < sizeof(T)) {
+        throw std::runtime_error{"binary log: truncated frame"};
+    }
+    auto u = U{0};
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        u |= static_cast<U>(static_cast<unsigned char>(*p++)) << (8 * i);
+    }
+    return static_cast<T>(u);
+}
+
+void writeFrame (std::ostream& os, const std::vector<char>& frame) {
+    auto size = uint32_t(frame.size());
+    char length[4];
+    for (size_t i = 0; i < sizeof(length); ++i) {
+        length[i] = static_cast<char>((size >> (8 * i)) & 0xff);
+    }
+    os.write(length, sizeof(length));
+    os.write(frame.data(), frame.size());
+}
+
+void writeTimestamp (std::ostream& os, int64_t timestamp) {
+    // Same layout as util::LogSafely's local clock formatting.
+    namespace pt = boost::posix_time;
+    auto t = pt::ptime{boost::gregorian::date{1970, 1, 1}} + pt::microseconds(timestamp);
+    auto tod = t.time_of_day();
+    auto fill = os.fill('0');
+    os << std::setw(4) << t.date().year() << '-'
+       << std::setw(2) << int(t.date().month()) << '-'
+       << std::setw(2) << t.date().day() << 'T'
+       << std::setw(2) << tod.hours() << ':'
+       << std::setw(2) << tod.minutes() << ':'
+       << std::setw(2) << tod.seconds() << '.'
+       << std::setw(6) << tod.fractional_seconds();
+    os.fill(fill);
+}
+
+} // anonymous namespace
+
+const char* attributeName (Attribute a) {
+    switch (a) {
+        case Attribute::channel: return "Channel";
+        case Attribute::role: return "Role";
+        case Attribute::protocol: return "Protocol";
+        case Attribute::devicePath: return "DevicePath";
+        case Attribute::remoteEndpoint: return "RemoteEndpoint";
+        case Attribute::serialId: return "SerialId";
+        case Attribute::requestId: return "RequestId";
+    }
+    return "";
+}
+
+void Encoder::writeHeader (std::ostream& os) {
+    os.write(magic, sizeof(magic));
+    mStrings.clear();
+}
+
+void Encoder::encode (std::ostream& os, const Record& rec) {
+    // Clear the table here rather than in intern(), so a record never refers to an ID which one
+    // of its own later values has reassigned.
+    auto unseen = size_t(std::count_if(rec.attributes.begin(), rec.attributes.end(),
+        [this](const std::string* a) { return a && !mStrings.count(*a); }));
+    if (mStrings.size() + unseen > maxInternedStrings) {
+        mStrings.clear();
+    }
+
+    auto ids = std::array<uint32_t, attributeCount>{};
+    for (size_t i = 0; i < attributeCount; ++i) {
+        if (rec.attributes[i]) {
+            ids[i] = intern(os, *rec.attributes[i]);
+        }
+    }
+
+    mFrame.clear();
+    put(mFrame, uint8_t(FrameType::record));
+    put(mFrame, int64_t(rec.timestamp));
+    put(mFrame, int32_t(rec.severity));
+    put(mFrame, uint8_t(std::count_if(rec.attributes.begin(), rec.attributes.end(),
+        [](const std::string* a) { return a != nullptr; })));
+    for (size_t i = 0; i < attributeCount; ++i) {
+        if (rec.attributes[i]) {
+            put(mFrame, uint8_t(i));
+            put(mFrame, ids[i]);
+        }
+    }
+    if (rec.message) {
+        auto size = std::min(rec.message->size(), maxFrameSize - mFrame.size());
+        mFrame.insert(mFrame.end(), rec.message->begin(), rec.message->begin() + size);
+    }
+    writeFrame(os, mFrame);
+}
+
+uint32_t Encoder::intern (std::ostream& os, const std::string& s) {
+    auto iter = mStrings.find(s);
+    if (iter != mStrings.end()) {
+        return iter->second;
+    }
+    auto id = uint32_t(mStrings.size());
+    mStrings.emplace(s, id);
+
+    mFrame.clear();
+    put(mFrame, uint8_t(FrameType::string));
+    put(mFrame, id);
+    auto size = std::min(s.size(), maxFrameSize - mFrame.size());
+    mFrame.insert(mFrame.end(), s.begin(), s.begin() + size);
+    writeFrame(os, mFrame);
+    return id;
+}
+
+Decoder::Decoder (std::istream& in)
+    : mIn(in)
+{
+    char header[sizeof(magic)];
+    if (!mIn.read(header, sizeof(header)) || !std::equal(header, header + sizeof(header), magic)) {
+        throw std::runtime_error{"binary log: bad magic number"};
+    }
+}
+
+bool Decoder::readFrame () {
+    char length[4];
+    if (!mIn.read(length, sizeof(length))) {
+        return false;
+    }
+    const char* p = length;
+    auto size = get<uint32_t>(p, length + sizeof(length));
+    if (size > maxFrameSize) {
+        throw std::runtime_error{"binary log: frame too long"};
+    }
+    mFrame.resize(size);
+    return bool(mIn.read(mFrame.data(), mFrame.size()));
+}
+
+bool Decoder::next (std::ostream& out) {
+    while (readFrame()) {
+        const char* p = mFrame.data();
+        const char* end = p + mFrame.size();
+        auto type = FrameType(get<uint8_t>(p, end));
+
+        if (type == FrameType::string) {
+            auto id = get<uint32_t>(p, end);
+            mStrings[id].assign(p, end);
+            continue;
+        }
+        if (type != FrameType::record) {
+            throw std::runtime_error{"binary log: unknown frame type"};
+        }
+
+        auto timestamp = get<int64_t>(p, end);
+        get<int32_t>(p, end);  // severity: not part of the text format
+        auto n = get<uint8_t>(p, end);
+        auto attributes = std::array<const std::string*, attributeCount>{};
+        for (auto i = 0; i < n; ++i) {
+            auto a = get<uint8_t>(p, end);
+            auto id = get<uint32_t>(p, end);
+            auto iter = mStrings.find(id);
+            if (a >= attributeCount || iter == mStrings.end()) {
+                throw std::runtime_error{"binary log: bad attribute reference"};
+            }
+            attributes[a] = &iter->second;
+        }
+
+        auto attr = [&](Attribute a) { return attributes[size_t(a)]; };
+        out << '[';
+        writeTimestamp(out, timestamp);
+        out << ']';
+        if (auto a = attr(Attribute::channel)) { out << ' ' << *a; }
+        if (auto a = attr(Attribute::role)) { out << " [" << *a << ']'; }
+        if (auto a = attr(Attribute::protocol)) { out << ' ' << *a; }
+        if (auto a = attr(Attribute::devicePath)) { out << " [" << *a << ']'; }
+        if (auto a = attr(Attribute::remoteEndpoint)) { out << " [" << *a << ']'; }
+        if (auto a = attr(Attribute::serialId)) { out << " [" << *a << ']'; }
+        if (auto a = attr(Attribute::requestId)) { out << " [RequestId=" << *a << ']'; }
+        out << ' ';
+        out.write(p, end - p);
+        out << '\n';
+        return true;
+    }
+    return false;
+}
+
+}}} // namespace util::log::binary
@@ -0,0 +1,461 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/flightrecorder.hpp>
+
+#include <boost/log/attributes/clock.hpp>
+#include <boost/log/attributes/value_extraction.hpp>
+
+#include <boost/predef.h>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <type_traits>
+#include <csignal>
+#include <cstring>
+
+#if BOOST_OS_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace util { namespace log {
+
+struct FlightRecorderBackend::Ring {
+    // A single-producer ring of fixed-size slots. The owning thread writes; `dump()` reads. Each
+    // slot carries a sequence number which is odd while the slot is being written, so a reader can
+    // skip slots torn by a concurrent write.
+
+    struct Slot {
+        std::atomic<uint32_t> sequence { 0 };
+        int64_t timestamp;
+        int32_t severity;
+        uint8_t channelSize;
+        uint8_t messageSize;
+        char channel[30];
+        char message[200];
+    };
+
+    explicit Ring (size_t n)
+        : slots(new Slot[std::max(n, size_t(1))])
+        , size(std::max(n, size_t(1)))
+    {}
+
+    std::unique_ptr<Slot[]> slots;
+    const size_t size;
+    std::atomic<uint64_t> head { 0 };
+    std::atomic<bool> inUse { true };
+};
+
+namespace {
+
+std::atomic<uint64_t> gNextBackendId { 1 };
+std::atomic<const FlightRecorderBackend*> gSignalBackend { nullptr };
+
+struct ThreadRing {
+    // This thread's ring in one backend. Only the backend owns the ring, so the ring goes away
+    // with the backend, and `ring` is valid whenever `backendId` names the backend in use.
+
+    uint64_t backendId = 0;
+    FlightRecorderBackend::Ring* ring = nullptr;
+    std::weak_ptr<FlightRecorderBackend::Ring> owner;
+};
+
+struct ThreadRings {
+    // This thread's rings in the last few backends it logged to, so that two backends alive at
+    // once, e.g., across a sink rebuild, don't take turns evicting each other's ring. Releases the
+    // rings for reuse by other threads when this thread exits.
+
+    ~ThreadRings () {
+        for (auto& tr : rings) {
+            release(tr);
+        }
+    }
+
+    static void release (ThreadRing& tr) {
+        if (auto r = tr.owner.lock()) {
+            r->inUse.store(false, std::memory_order_release);
+        }
+        tr = ThreadRing{};
+    }
+
+    ThreadRing& slotFor () {
+        // An unused slot, a slot whose backend is gone, or else the oldest one.
+        for (auto& tr : rings) {
+            if (!tr.backendId || tr.owner.expired()) {
+                release(tr);
+                return tr;
+            }
+        }
+        auto& tr = rings[next++ % rings.size()];
+        release(tr);
+        return tr;
+    }
+
+    std::array<ThreadRing, 4> rings;
+    size_t next = 0;
+};
+
+thread_local ThreadRings tThreadRings;
+
+const char* levelName (int severity) {
+    switch (severity) {
+        case -2: return "trace";
+        case -1: return "debug";
+        case 0: return "info";
+        case 1: return "warning";
+        case 2: return "error";
+        case 3: return "fatal";
+        default: return "?";
+    }
+}
+
+class Writer {
+    // Buffered, allocation-free output to a file descriptor.
+
+public:
+    explicit Writer (int fd) : mFd(fd) {}
+    ~Writer () { flush(); }
+
+    void put (const char* s, size_t n) {
+        while (n) {
+            auto chunk = std::min(n, sizeof(mBuf) - mSize);
+            std::memcpy(mBuf + mSize, s, chunk);
+            mSize += chunk;
+            s += chunk;
+            n -= chunk;
+            if (mSize == sizeof(mBuf)) {
+                flush();
+            }
+        }
+    }
+
+    void put (const char* s) { put(s, std::strlen(s)); }
+
+    void putDigits (uint64_t value, int width) {
+        char digits[20];
+        auto n = 0;
+        do {
+            digits[n++] = char('0' + value % 10);
+            value /= 10;
+        } while (value && n < 20);
+        while (n < width && n < 20) {
+            digits[n++] = '0';
+        }
+        while (n) {
+            put(&digits[--n], 1);
+        }
+    }
+
+    void putTimestamp (int64_t micros) {
+        // Microseconds since 1970-01-01 to YYYY-MM-DDTHH:MM:SS.ffffff, without touching the C
+        // library's time zone state. The civil date conversion is Howard Hinnant's.
+        auto seconds = micros >= 0 ? micros / 1000000 : (micros - 999999) / 1000000;
+        auto fraction = micros - seconds * 1000000;
+        auto days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+        auto tod = seconds - days * 86400;
+
+        auto z = days + 719468;
+        auto era = (z >= 0 ? z : z - 146096) / 146097;
+        auto doe = z - era * 146097;
+        auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        auto mp = (5 * doy + 2) / 153;
+        auto day = doy - (153 * mp + 2) / 5 + 1;
+        auto month = mp < 10 ? mp + 3 : mp - 9;
+        auto year = yoe + era * 400 + (month <= 2);
+
+        putDigits(uint64_t(year), 4);
+        put("-");
+        putDigits(uint64_t(month), 2);
+        put("-");
+        putDigits(uint64_t(day), 2);
+        put("T");
+        putDigits(uint64_t(tod / 3600), 2);
+        put(":");
+        putDigits(uint64_t(tod / 60 % 60), 2);
+        put(":");
+        putDigits(uint64_t(tod % 60), 2);
+        put(".");
+        putDigits(uint64_t(fraction), 6);
+    }
+
+    void flush () {
+        auto p = mBuf;
+        while (mSize) {
+#if BOOST_OS_WINDOWS
+            auto n = ::_write(mFd, p, unsigned(mSize));
+#else
+            auto n = ::write(mFd, p, mSize);
+#endif
+            if (n <= 0) {
+                mFailed = true;
+                mSize = 0;
+                break;
+            }
+            p += n;
+            mSize -= size_t(n);
+        }
+    }
+
+    bool failed () const { return mFailed; }
+
+private:
+    int mFd;
+    char mBuf[4096];
+    size_t mSize = 0;
+    bool mFailed = false;
+};
+
+int openDumpFile (const char* path) {
+#if BOOST_OS_WINDOWS
+    return ::_open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+void closeDumpFile (int fd) {
+#if BOOST_OS_WINDOWS
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+const int gFatalSignals[] = {
+    SIGSEGV, SIGABRT, SIGILL, SIGFPE,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+
+using SignalHandler = void (*)(int);
+
+std::mutex gSignalMutex;
+SignalHandler gPreviousHandlers[std::extent<decltype(gFatalSignals)>::value];
+bool gHandlingSignals = false;
+// What each of gFatalSignals was handled by before any backend's `handleFatalSignals()`. Guarded
+// by gSignalMutex, but read without it by the signal handler.
+
+size_t signalIndex (int sig) {
+    return size_t(std::find(std::begin(gFatalSignals), std::end(gFatalSignals), sig)
+        - std::begin(gFatalSignals));
+}
+
+extern "C" void handleFatalSignal (int sig) {
+    // Pass the signal on to whatever handled it before us: the default action, unless the
+    // program had its own handler.
+    std::signal(sig, gPreviousHandlers[signalIndex(sig)]);
+    if (auto backend = gSignalBackend.load()) {
+        char reason[] = "signal   ";
+        reason[7] = char('0' + sig / 10 % 10);
+        reason[8] = char('0' + sig % 10);
+        backend->dump(reason);
+    }
+    std::raise(sig);
+}
+
+void restoreFatalSignals () {
+    // Call with gSignalMutex held.
+    if (!gHandlingSignals) {
+        return;
+    }
+    for (size_t i = 0; i < std::extent<decltype(gFatalSignals)>::value; ++i) {
+        std::signal(gFatalSignals[i], gPreviousHandlers[i]);
+    }
+    gHandlingSignals = false;
+}
+
+} // anonymous namespace
+
+constexpr Level FlightRecorderBackend::noTrigger;
+
+FlightRecorderBackend::FlightRecorderBackend (std::string dumpPath, size_t recordsPerThread,
+        Level trigger)
+    : mDumpPath(std::move(dumpPath))
+    , mRecordsPerThread(recordsPerThread)
+    , mTrigger(static_cast<int>(trigger))
+    , mId(gNextBackendId++)
+{
+    for (auto& r : mRings) {
+        r.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+FlightRecorderBackend::~FlightRecorderBackend () {
+    std::lock_guard<std::mutex> lock {gSignalMutex};
+    auto self = static_cast<const FlightRecorderBackend*>(this);
+    if (gSignalBackend.compare_exchange_strong(self, nullptr)) {
+        restoreFatalSignals();
+    }
+}
+
+FlightRecorderBackend::Ring* FlightRecorderBackend::ring () {
+    auto& rings = tThreadRings;
+    for (auto& tr : rings.rings) {
+        if (tr.backendId == mId) {
+            return tr.ring;
+        }
+    }
+
+    auto& tr = rings.slotFor();
+    tr.backendId = mId;
+
+    // Keep the history of exited threads until we run out of rings.
+    std::lock_guard<std::mutex> lock {mMutex};
+    if (mOwnedRings.size() < maxRings) {
+        auto r = std::make_shared<Ring>(mRecordsPerThread);
+        mOwnedRings.push_back(r);
+        mRings[mOwnedRings.size() - 1].store(r.get(), std::memory_order_release);
+        mRingCount.store(mOwnedRings.size(), std::memory_order_release);
+        tr.ring = r.get();
+        tr.owner = r;
+        return tr.ring;
+    }
+    for (auto& r : mOwnedRings) {
+        auto expected = false;
+        if (r->inUse.compare_exchange_strong(expected, true)) {
+            tr.ring = r.get();
+            tr.owner = r;
+            return tr.ring;
+        }
+    }
+    return nullptr;
+}
+
+void FlightRecorderBackend::consume (const boost::log::record_view& rec) {
+    namespace attrs = boost::log::attributes;
+    static const boost::log::attribute_name timestampName {"TimeStamp"};
+    static const boost::log::attribute_name severityName {"Severity"};
+    static const boost::log::attribute_name channelName {"Channel"};
+    static const boost::log::attribute_name messageName {"Message"};
+    static const auto epoch = boost::posix_time::ptime{boost::gregorian::date{1970, 1, 1}};
+
+    auto severity = boost::log::extract<int>(severityName, rec);
+    auto level = severity ? *severity : 0;
+
+    if (auto r = ring()) {
+        auto head = r->head.load(std::memory_order_relaxed);
+        auto& slot = r->slots[head % r->size];
+        auto sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto timestamp = boost::log::extract<attrs::local_clock::value_type>(timestampName, rec);
+        slot.timestamp = timestamp ? (*timestamp - epoch).total_microseconds() : 0;
+        slot.severity = level;
+        auto channel = boost::log::extract<std::string>(channelName, rec);
+        slot.channelSize = uint8_t(channel ? std::min(channel->size(), sizeof(slot.channel)) : 0);
+        if (slot.channelSize) {
+            std::memcpy(slot.channel, channel->data(), slot.channelSize);
+        }
+        auto message = boost::log::extract<std::string>(messageName, rec);
+        slot.messageSize = uint8_t(message ? std::min(message->size(), sizeof(slot.message)) : 0);
+        if (slot.messageSize) {
+            std::memcpy(slot.message, message->data(), slot.messageSize);
+        }
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        r->head.store(head + 1, std::memory_order_release);
+    }
+
+    if (level >= mTrigger && !mTriggered.exchange(true, std::memory_order_relaxed)) {
+        write("trigger level");
+    }
+}
+
+bool FlightRecorderBackend::dump (const char* reason) const {
+    mTriggered.store(false, std::memory_order_relaxed);
+    return write(reason);
+}
+
+bool FlightRecorderBackend::write (const char* reason) const {
+    if (mDumping.test_and_set(std::memory_order_acquire)) {
+        return false;
+    }
+    auto fd = openDumpFile(mDumpPath.c_str());
+    if (fd < 0) {
+        mDumping.clear(std::memory_order_release);
+        return false;
+    }
+
+    auto failed = false;
+    {
+        Writer out {fd};
+        out.put("flight recorder dump: ");
+        out.put(reason);
+        out.put("\n");
+
+        auto count = mRingCount.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            auto r = mRings[i].load(std::memory_order_acquire);
+            auto head = r ? r->head.load(std::memory_order_acquire) : 0;
+            if (!head) {
+                continue;
+            }
+            out.put("--- thread ring ");
+            out.putDigits(i, 1);
+            out.put(" ---\n");
+            auto first = head > r->size ? head - r->size : 0;
+            for (auto n = first; n < head; ++n) {
+                auto& slot = r->slots[n % r->size];
+                auto before = slot.sequence.load(std::memory_order_acquire);
+                if (before & 1) {
+                    continue;
+                }
+                Ring::Slot copy;
+                copy.timestamp = slot.timestamp;
+                copy.severity = slot.severity;
+                copy.channelSize = std::min<uint8_t>(slot.channelSize, sizeof(copy.channel));
+                copy.messageSize = std::min<uint8_t>(slot.messageSize, sizeof(copy.message));
+                std::memcpy(copy.channel, slot.channel, copy.channelSize);
+                std::memcpy(copy.message, slot.message, copy.messageSize);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != before) {
+                    continue;
+                }
+
+                out.put("[");
+                out.putTimestamp(copy.timestamp);
+                out.put("] ");
+                out.put(levelName(copy.severity));
+                if (copy.channelSize) {
+                    out.put(" ");
+                    out.put(copy.channel, copy.channelSize);
+                }
+                out.put(" ");
+                out.put(copy.message, copy.messageSize);
+                out.put("\n");
+            }
+        }
+        out.flush();
+        failed = out.failed();
+    }
+    closeDumpFile(fd);
+    mDumping.clear(std::memory_order_release);
+    return !failed;
+}
+
+void FlightRecorderBackend::handleFatalSignals () {
+    std::lock_guard<std::mutex> lock {gSignalMutex};
+    gSignalBackend.store(this);
+    if (gHandlingSignals) {
+        return;
+    }
+    for (size_t i = 0; i < std::extent<decltype(gFatalSignals)>::value; ++i) {
+        gPreviousHandlers[i] = SIG_DFL;
+        auto previous = std::signal(gFatalSignals[i], &handleFatalSignal);
+        gPreviousHandlers[i] = previous == SIG_ERR ? SIG_DFL : previous;
+    }
+    gHandlingSignals = true;
+}
+
+}} // namespace util::log
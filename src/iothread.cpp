@@ -5,6 +5,7 @@
 
 #include <util/asio/iothread.hpp>
 
+#include <boost/predef.h>
 #include <boost/utility/in_place_factory.hpp>
 
 #include <exception>
@@ -12,8 +13,29 @@
 
 #include <cstdlib>
 
+#if BOOST_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace util { namespace asio {
 
+namespace {
+
+void pinThisThread (unsigned cpu) {
+#if BOOST_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    // If this fails (e.g., the CPU is not in our cpuset), we just run unpinned.
+#else
+    (void)cpu;
+#endif
+}
+
+} // anonymous namespace
+
 IoThread::IoThread ()
     : mWork(boost::in_place(std::ref(mContext)))
     // Run the io_service in a separate thread
@@ -21,6 +43,15 @@ IoThread::IoThread ()
 {
 }
 
+IoThread::IoThread (unsigned cpu)
+    : mWork(boost::in_place(std::ref(mContext)))
+    , mJoin(std::async(std::launch::async, [this, cpu] () {
+        pinThisThread(cpu);
+        return mContext.run();
+    }))
+{
+}
+
 IoThread::~IoThread () {
     // If this throws, you have a bug in your program. Call join() before the
     // destructor, catch the exception, and figure out what's wrong.
@@ -0,0 +1,49 @@
+// Copyright (c) 2014-2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/asio/iothreadpool.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace util { namespace asio {
+
+IoThreadPool::IoThreadPool (size_t size)
+    : mLoads(new std::atomic<size_t>[std::max(size, size_t(1))])
+{
+    size = std::max(size, size_t(1));
+    auto nCpus = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < size; ++i) {
+        mLoads[i].store(0, std::memory_order_relaxed);
+        mThreads.emplace_back(new IoThread(unsigned(i % nCpus)));
+    }
+}
+
+size_t IoThreadPool::join () {
+    auto n = size_t(0);
+    for (auto& t : mThreads) {
+        n += t->join();
+    }
+    return n;
+}
+
+size_t IoThreadPool::leastLoaded () const {
+    auto best = size_t(0);
+    auto bestLoad = load(0);
+    for (size_t i = 1; i < size() && bestLoad; ++i) {
+        auto l = load(i);
+        if (l < bestLoad) {
+            best = i;
+            bestLoad = l;
+        }
+    }
+    return best;
+}
+
+size_t IoThreadPool::defaultSize () {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+}} // namespace util::asio
@@ -6,20 +6,51 @@
 #define BOOST_LOG_USE_NATIVE_SYSLOG
 
 #include <util/log.hpp>
+#include <util/binarylog.hpp>
+#include <util/flightrecorder.hpp>
 
 #include <util/logsafely.hpp>
 
 #include <boost/log/common.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/attributes/clock.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/syslog_backend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
 #include <boost/log/sources/logger.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/file.hpp>
 
+#include <boost/asio/ip/address.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
@@ -28,34 +59,420 @@ namespace util {
 namespace log {
 
 namespace {
-    void initFileSink (const std::string&);
-    void initConsoleSink (bool);
-    void initSyslogSink (const std::string&);
+
+struct SinkSettings {
+    // Everything the command line can say about sinks. Each option's notifier updates one field.
+    // program_options notifies options in alphabetical order, so the sinks are rebuilt once, from
+    // the notifier of the last sink option, --log-syslog-address. It has a default value so that
+    // every notify reaches it.
+
+    std::string file;
+    bool console = false;
+    std::string syslog;
+    std::string syslogHost;
+    unsigned short syslogPort = 514;
+    std::string binaryFile;
+
+    bool async = false;
+    size_t asyncQueueSize = 8192;
+    std::string asyncOverflow = "block";
+    unsigned asyncFlushInterval = 1000;
+    size_t asyncFlushSize = 256;
+
+    uintmax_t rotateSize = 0;
+    unsigned rotateInterval = 0;
+    unsigned maxFiles = 0;
+
+    std::string flightRecorder;
+    size_t flightRecorderSize = 1024;
+    std::string flightRecorderTrigger = "none";
+};
+
+SinkSettings& sinkSettings () {
+    static SinkSettings settings;
+    return settings;
+}
+
+void applySinkSettings ();
+
+template <class T>
+std::function<void(const T&)> sinkSetting (T SinkSettings::* member) {
+    return [member](const T& value) {
+        sinkSettings().*member = value;
+    };
+}
+
+std::pair<std::string, unsigned short> parseSyslogAddress (const std::string& value) {
+    // <host>, <host>:<port>, <IPv6 address>, or [<IPv6 address>]:<port>. The port defaults to 514,
+    // and an empty value means the local syslog.
+    if (value.empty()) {
+        return {{}, 514};
+    }
+    auto invalid = [&value] {
+        return po::validation_error{po::validation_error::invalid_option_value,
+            "log-syslog-address", value};
+    };
+    auto isIpv6 = [](const std::string& host) {
+        auto ec = boost::system::error_code{};
+        boost::asio::ip::address_v6::from_string(host, ec);
+        return !ec;
+    };
+
+    auto host = value;
+    auto port = std::string{};
+    auto hasPort = false;
+    if (!value.empty() && value[0] == '[') {
+        auto close = value.find(']');
+        if (close == std::string::npos || !isIpv6(value.substr(1, close - 1))) {
+            throw invalid();
+        }
+        host = value.substr(1, close - 1);
+        if (close + 1 < value.size()) {
+            if (value[close + 1] != ':') {
+                throw invalid();
+            }
+            port = value.substr(close + 2);
+            hasPort = true;
+        }
+    }
+    else if (std::count(value.begin(), value.end(), ':') == 1) {
+        auto colon = value.find(':');
+        host = value.substr(0, colon);
+        port = value.substr(colon + 1);
+        hasPort = true;
+    }
+    else if (value.find(':') != std::string::npos && !isIpv6(value)) {
+        throw invalid();
+    }
+
+    if (host.empty()) {
+        throw invalid();
+    }
+    if (!hasPort) {
+        return {host, 514};
+    }
+    if (port.empty() || port.size() > 5
+            || !std::all_of(port.begin(), port.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        throw invalid();
+    }
+    auto number = std::stoul(port);
+    if (!number || number > 65535) {
+        throw invalid();
+    }
+    return {host, static_cast<unsigned short>(number)};
+}
+
+void validateOverflow (const std::string& value) {
+    if (value != "block" && value != "drop") {
+        throw po::validation_error{po::validation_error::invalid_option_value,
+            "log-async-overflow", value};
+    }
+}
+
+std::atomic<uint64_t> gDroppedRecords { 0 };
+
+std::mutex gFlightRecorderMutex;
+boost::shared_ptr<FlightRecorderBackend> gFlightRecorder;
+// Installed by --log-flight-recorder, for dumpFlightRecorder().
+
+bool passesLevelFilter (const boost::log::attribute_value_set&);
+bool passesCoreFilter (const boost::log::attribute_value_set&);
+
 } // anonymous namespace
 
 boost::program_options::options_description optionsDescription (ConsoleDefault consoleDefault) {
     boost::log::add_common_attributes();
     boost::log::core::get()->add_global_attribute("Scope", boost::log::attributes::named_scope());
     boost::log::core::get()->set_logging_enabled(false);
+    boost::log::core::get()->set_filter(&passesCoreFilter);
 
+    auto defaults = SinkSettings{};
     auto opts = po::options_description{"Log options"};
     opts.add_options()
         ("log-file", po::value<std::string>()
             ->value_name("<file>")
-            ->notifier(&initFileSink), "log to file with given path")
+            ->notifier(sinkSetting(&SinkSettings::file)), "log to file with given path")
         ("log-console", po::value<bool>()
             ->value_name("0|1")
             ->default_value(static_cast<bool>(consoleDefault))
-            ->notifier(&initConsoleSink),
+            ->notifier(sinkSetting(&SinkSettings::console)),
             "log to console")
         ("log-syslog", po::value<std::string>()
-            ->value_name("<name>")->notifier(&initSyslogSink),
+            ->value_name("<name>")->notifier(sinkSetting(&SinkSettings::syslog)),
             "log to syslog with given program name")
+        ("log-syslog-address", po::value<std::string>()
+            ->value_name("<host>[:<port>]")
+            ->default_value(std::string{}, "")
+            ->notifier([](const std::string& value) {
+                auto& settings = sinkSettings();
+                std::tie(settings.syslogHost, settings.syslogPort) = parseSyslogAddress(value);
+                // The last sink option notified; see SinkSettings.
+                applySinkSettings();
+            }),
+            "send syslog records over UDP to the given address instead of the local syslog "
+            "(write an IPv6 address with a port as [<address>]:<port>)")
+        ("log-binary-file", po::value<std::string>()
+            ->value_name("<file>")->notifier(sinkSetting(&SinkSettings::binaryFile)),
+            "log to file with given path in binary format (read it with cxx-util-logdecode)")
+        ("log-async", po::value<bool>()
+            ->value_name("0|1")
+            ->default_value(defaults.async)
+            ->notifier(sinkSetting(&SinkSettings::async)),
+            "format and write log records on a dedicated thread per sink")
+        ("log-async-queue-size", po::value<size_t>()
+            ->value_name("<records>")
+            ->default_value(defaults.asyncQueueSize)
+            ->notifier(sinkSetting(&SinkSettings::asyncQueueSize)),
+            "maximum number of records waiting for an asynchronous sink")
+        ("log-async-overflow", po::value<std::string>()
+            ->value_name("block|drop")
+            ->default_value(defaults.asyncOverflow)
+            ->notifier([](const std::string& value) {
+                validateOverflow(value);
+                sinkSetting(&SinkSettings::asyncOverflow)(value);
+            }),
+            "whether to block or drop records when an asynchronous sink's queue is full")
+        ("log-async-flush-interval", po::value<unsigned>()
+            ->value_name("<ms>")
+            ->default_value(defaults.asyncFlushInterval)
+            ->notifier(sinkSetting(&SinkSettings::asyncFlushInterval)),
+            "flush asynchronous file and console sinks at least this often (0 to disable)")
+        ("log-async-flush-size", po::value<size_t>()
+            ->value_name("<records>")
+            ->default_value(defaults.asyncFlushSize)
+            ->notifier(sinkSetting(&SinkSettings::asyncFlushSize)),
+            "flush asynchronous file and console sinks after this many records")
+        ("log-rotate-size", po::value<uintmax_t>()
+            ->value_name("<bytes>")
+            ->default_value(defaults.rotateSize)
+            ->notifier(sinkSetting(&SinkSettings::rotateSize)),
+            "rotate the log file when it reaches this size (0 to disable)")
+        ("log-rotate-interval", po::value<unsigned>()
+            ->value_name("<seconds>")
+            ->default_value(defaults.rotateInterval)
+            ->notifier(sinkSetting(&SinkSettings::rotateInterval)),
+            "rotate the log file this often (0 to disable)")
+        ("log-max-files", po::value<unsigned>()
+            ->value_name("<n>")
+            ->default_value(defaults.maxFiles)
+            ->notifier(sinkSetting(&SinkSettings::maxFiles)),
+            "keep at most this many compressed rotated log files (0 for no limit)")
+    ;
+    opts.add_options()
+        ("log-flight-recorder", po::value<std::string>()
+            ->value_name("<file>")->notifier(sinkSetting(&SinkSettings::flightRecorder)),
+            "keep recent records in memory, and write them to the given file on a fatal signal, "
+            "a record at the trigger level, or a call to util::log::dumpFlightRecorder()")
+        ("log-flight-recorder-size", po::value<size_t>()
+            ->value_name("<records>")
+            ->default_value(defaults.flightRecorderSize)
+            ->notifier(sinkSetting(&SinkSettings::flightRecorderSize)),
+            "number of records the flight recorder keeps per thread")
+        ("log-flight-recorder-trigger", po::value<std::string>()
+            ->value_name("<level>|none")
+            ->default_value(defaults.flightRecorderTrigger)
+            ->notifier([](const std::string& value) {
+                try {
+                    if (value != "none") {
+                        parseLevel(value);
+                    }
+                }
+                catch (std::invalid_argument&) {
+                    throw po::validation_error{po::validation_error::invalid_option_value,
+                        "log-flight-recorder-trigger", value};
+                }
+                sinkSetting(&SinkSettings::flightRecorderTrigger)(value);
+            }),
+            "dump the flight recorder when a record at or above this level is logged (once, until "
+            "the next dump by other means)")
+    ;
+    opts.add(levelOptionsDescription());
+    return opts;
+}
+
+boost::program_options::options_description levelOptionsDescription () {
+    auto opts = po::options_description{"Log level options"};
+    opts.add_options()
+        ("log-level", po::value<std::string>()
+            ->value_name("<level>")
+            ->default_value("trace")
+            ->notifier([](const std::string& value) {
+                try {
+                    setLevel(parseLevel(value));
+                }
+                catch (std::invalid_argument&) {
+                    throw po::validation_error{po::validation_error::invalid_option_value,
+                        "log-level", value};
+                }
+            }),
+            "minimum severity to log: trace, debug, info, warning, error, or fatal")
+        ("log-filter", po::value<std::vector<std::string>>()
+            ->value_name("<channel>=<level>")
+            ->composing()
+            ->default_value(std::vector<std::string>{}, "")
+            ->notifier([](const std::vector<std::string>& values) {
+                auto levels = std::map<std::string, int>{};
+                for (auto& value : values) {
+                    auto eq = value.rfind('=');
+                    try {
+                        if (eq == std::string::npos) {
+                            throw std::invalid_argument{value};
+                        }
+                        levels[value.substr(0, eq)] =
+                            static_cast<int>(parseLevel(value.substr(eq + 1)));
+                    }
+                    catch (std::invalid_argument&) {
+                        throw po::validation_error{po::validation_error::invalid_option_value,
+                            "log-filter", value};
+                    }
+                }
+                _::setChannelLevels(std::move(levels));
+            }),
+            "minimum severity to log for one channel, overriding --log-level (repeatable)")
     ;
     return opts;
 }
 
+Level parseLevel (const std::string& name) {
+    static const std::pair<const char*, Level> names[] = {
+        { "trace", Level::trace },
+        { "debug", Level::debug },
+        { "info", Level::info },
+        { "warning", Level::warning },
+        { "error", Level::error },
+        { "fatal", Level::fatal }
+    };
+    for (auto& n : names) {
+        if (name == n.first) {
+            return n.second;
+        }
+    }
+    throw std::invalid_argument{"unknown log level: " + name};
+}
+
+uint64_t droppedRecords () {
+    return gDroppedRecords.load(std::memory_order_relaxed);
+}
+
+bool dumpFlightRecorder () {
+    auto recorder = boost::shared_ptr<FlightRecorderBackend>{};
+    {
+        std::lock_guard<std::mutex> lock {gFlightRecorderMutex};
+        recorder = gFlightRecorder;
+    }
+    return recorder && recorder->dump("requested");
+}
+
+namespace _ {
+
+std::atomic<int> gMinLevel { static_cast<int>(Level::trace) };
+std::atomic<bool> gHaveChannelLevels { false };
+std::atomic<bool> gRecordAllLevels { false };
+
 namespace {
+    using ChannelLevels = std::map<std::string, int>;
+
+    // Replaced, never modified, so a reader may keep using the snapshot it has. Null means no
+    // channel levels. Both are guarded by gChannelLevelsMutex.
+    std::mutex gChannelLevelsMutex;
+    std::shared_ptr<const ChannelLevels> gChannelLevels;
+    std::atomic<unsigned> gChannelLevelsVersion { 0 };
+
+    const ChannelLevels* channelLevels () {
+        // Each thread holds its own reference to the current snapshot, and only takes the mutex to
+        // pick up a new one after setChannelLevel() or setChannelLevels() has replaced it.
+        thread_local std::shared_ptr<const ChannelLevels> levels;
+        thread_local unsigned version = ~0u;
+        if (version != gChannelLevelsVersion.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock {gChannelLevelsMutex};
+            levels = gChannelLevels;
+            version = gChannelLevelsVersion.load(std::memory_order_relaxed);
+        }
+        return levels.get();
+    }
+
+    void publishChannelLevels (std::shared_ptr<const ChannelLevels> levels) {
+        // Call with gChannelLevelsMutex held.
+        gChannelLevels = std::move(levels);
+        gChannelLevelsVersion.fetch_add(1, std::memory_order_release);
+        gHaveChannelLevels.store(bool(gChannelLevels), std::memory_order_relaxed);
+    }
+
+    struct ChannelAttribute : Logger {
+        // Boost.Log only hands out copies of a logger's channel name, so reach the attribute
+        // itself, which is protected. Naming it through a derived class makes that legal.
+        static const boost::log::attribute& get (const Logger& lg) {
+            return (lg.*&ChannelAttribute::get_channel_attribute)();
+        }
+    };
+} // anonymous namespace
+
+bool levelEnabled (const std::string& channel, int level) {
+    auto levels = channelLevels();
+    if (levels) {
+        auto iter = levels->find(channel);
+        if (iter != levels->end()) {
+            return level >= iter->second;
+        }
+    }
+    return level >= gMinLevel.load(std::memory_order_relaxed);
+}
+
+bool channelEnabled (const Logger& lg, int level) {
+    // The attribute value refers to the logger's own copy of the name.
+    auto value = ChannelAttribute::get(lg).get_value();
+    return levelEnabled(value.extract_or_throw<std::string>(), level);
+}
+
+void setChannelLevels (std::map<std::string, int> levels) {
+    std::lock_guard<std::mutex> lock {gChannelLevelsMutex};
+    publishChannelLevels(levels.empty()
+        ? nullptr
+        : std::make_shared<const ChannelLevels>(std::move(levels)));
+}
+
+} // _
+
+namespace {
+
+bool passesLevelFilter (const boost::log::attribute_value_set& values) {
+    // Part of the core filter, so records made without UTIL_LOG_* (e.g., plain BOOST_LOG) are
+    // rejected before any sink formats them. With a flight recorder, a filter on each other sink.
+    static const boost::log::attribute_name severityName {"Severity"};
+    static const boost::log::attribute_name channelName {"Channel"};
+
+    auto severity = boost::log::extract<int>(severityName, values);
+    if (!severity) {
+        return true;
+    }
+    if (!_::gHaveChannelLevels.load(std::memory_order_relaxed)) {
+        return *severity >= _::gMinLevel.load(std::memory_order_relaxed);
+    }
+    static const std::string noChannel;
+    auto channel = boost::log::extract<std::string>(channelName, values);
+    return _::levelEnabled(channel ? *channel : noChannel, *severity);
+}
+
+bool passesCoreFilter (const boost::log::attribute_value_set& values) {
+    return _::gRecordAllLevels.load(std::memory_order_relaxed) || passesLevelFilter(values);
+}
+
+} // anonymous namespace
+
+void setLevel (Level level) {
+    _::gMinLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+void setChannelLevel (const std::string& channel, Level level) {
+    std::lock_guard<std::mutex> lock {_::gChannelLevelsMutex};
+    auto levels = _::gChannelLevels ? *_::gChannelLevels : _::ChannelLevels{};
+    levels[channel] = static_cast<int>(level);
+    _::publishChannelLevels(std::make_shared<const _::ChannelLevels>(std::move(levels)));
+}
+
+void clearChannelLevels () {
+    _::setChannelLevels({});
+}
 
 boost::log::formatter defaultFormatter () {
     namespace expr = boost::log::expressions;
@@ -88,9 +505,475 @@ boost::log::formatter defaultFormatter () {
         << " " << expr::smessage;
 }
 
-void initFileSink (const std::string& logFile) {
-    if (!logFile.size()) return;
+namespace {
+
+namespace sinks = boost::log::sinks;
+namespace keywords = boost::log::keywords;
+
+class BoundedQueue {
+    // Boost.Log queueing strategy for asynchronous_sink with a capacity and overflow policy chosen
+    // at run time, by calling `configure()` before the first record is enqueued. While the queue
+    // is empty, the feeding thread wakes up every idle interval to run an idle callback, which we
+    // use to flush batched output.
+
+public:
+    void configure (size_t capacity, bool dropOnOverflow,
+            std::chrono::milliseconds idleInterval, std::function<void()> onIdle) {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mCapacity = std::max(capacity, size_t(1));
+        mDropOnOverflow = dropOnOverflow;
+        mIdleInterval = idleInterval;
+        mOnIdle = std::move(onIdle);
+        mReady.notify_one();
+    }
+
+protected:
+    BoundedQueue () = default;
+
+    template <class Args>
+    explicit BoundedQueue (const Args&) {}
+
+    void enqueue (const boost::log::record_view& rec) {
+        std::unique_lock<std::mutex> lock {mMutex};
+        while (mQueue.size() >= mCapacity) {
+            if (mDropOnOverflow) {
+                gDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            mSpaceAvailable.wait(lock);
+        }
+        mQueue.push_back(rec);
+        if (mQueue.size() == 1) {
+            mReady.notify_one();
+        }
+    }
+
+    bool try_enqueue (const boost::log::record_view& rec) {
+        std::unique_lock<std::mutex> lock {mMutex, std::try_to_lock};
+        if (lock.owns_lock() && mQueue.size() < mCapacity) {
+            mQueue.push_back(rec);
+            if (mQueue.size() == 1) {
+                mReady.notify_one();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool try_dequeue_ready (boost::log::record_view& rec) {
+        return try_dequeue(rec);
+    }
+
+    bool try_dequeue (boost::log::record_view& rec) {
+        std::lock_guard<std::mutex> lock {mMutex};
+        return popFront(rec);
+    }
+
+    bool dequeue_ready (boost::log::record_view& rec) {
+        std::unique_lock<std::mutex> lock {mMutex};
+        while (!mInterrupted) {
+            if (popFront(rec)) {
+                return true;
+            }
+            if (!mIdleInterval.count()) {
+                mReady.wait(lock);
+            }
+            else if (std::cv_status::timeout == mReady.wait_for(lock, mIdleInterval)
+                    && mQueue.empty() && mOnIdle) {
+                auto onIdle = mOnIdle;
+                lock.unlock();
+                onIdle();
+                lock.lock();
+            }
+        }
+        mInterrupted = false;
+        return false;
+    }
+
+    void interrupt_dequeue () {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mInterrupted = true;
+        mReady.notify_one();
+    }
+
+private:
+    bool popFront (boost::log::record_view& rec) {
+        if (mQueue.empty()) {
+            return false;
+        }
+        rec.swap(mQueue.front());
+        mQueue.pop_front();
+        mSpaceAvailable.notify_one();
+        return true;
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mReady;
+    std::condition_variable mSpaceAvailable;
+    std::deque<boost::log::record_view> mQueue;
+    bool mInterrupted = false;
+
+    size_t mCapacity = 8192;
+    bool mDropOnOverflow = false;
+    std::chrono::milliseconds mIdleInterval {0};
+    std::function<void()> mOnIdle;
+};
+
+template <class Backend>
+class BatchingBackend : public sinks::basic_formatted_sink_backend<char,
+        sinks::combine_requirements<sinks::synchronized_feeding, sinks::flushing>::type> {
+    // Wraps a stream-based backend with auto_flush off, and flushes it after a number of records
+    // or an amount of time, whichever comes first.
+
+public:
+    BatchingBackend (boost::shared_ptr<Backend> backend,
+            size_t flushSize, std::chrono::milliseconds flushInterval)
+        : mBackend(std::move(backend))
+        , mFlushSize(std::max(flushSize, size_t(1)))
+        , mFlushInterval(flushInterval)
+    {}
+
+    void consume (const boost::log::record_view& rec, const string_type& formatted) {
+        mBackend->consume(rec, formatted);
+        if (++mPending >= mFlushSize
+                || (mFlushInterval.count() && Clock::now() - mLastFlush >= mFlushInterval)) {
+            flush();
+        }
+    }
+
+    void flush () {
+        if (mPending) {
+            mBackend->flush();
+            mPending = 0;
+        }
+        mLastFlush = Clock::now();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    boost::shared_ptr<Backend> mBackend;
+    size_t mFlushSize;
+    std::chrono::milliseconds mFlushInterval;
+    size_t mPending = 0;
+    Clock::time_point mLastFlush = Clock::now();
+};
+
+class BinaryFileBackend : public sinks::basic_sink_backend<
+        sinks::combine_requirements<sinks::synchronized_feeding, sinks::flushing>::type> {
+    // Write records in util::log::binary format. Nothing is formatted: the sink copies the
+    // timestamp, severity, string attributes, and message straight into a frame.
+
+public:
+    explicit BinaryFileBackend (const fs::path& path)
+        : mPath(path)
+        , mFile(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!mFile) {
+            throw std::runtime_error{"could not open " + path.string()};
+        }
+        mEncoder.writeHeader(mFile);
+    }
+
+    const fs::path& path () const { return mPath; }
+
+    void autoFlush (bool enable) { mAutoFlush = enable; }
+
+    void consume (const boost::log::record_view& rec) {
+        namespace attrs = boost::log::attributes;
+        using binary::Attribute;
+        static const auto epoch = boost::posix_time::ptime{boost::gregorian::date{1970, 1, 1}};
+
+        static const boost::log::attribute_name timestampName {"TimeStamp"};
+        static const boost::log::attribute_name severityName {"Severity"};
+        static const boost::log::attribute_name messageName {"Message"};
+        static const auto names = [] {
+            // Constructing an attribute_name takes a global lock; do it once.
+            std::array<boost::log::attribute_name, binary::attributeCount> n;
+            for (size_t i = 0; i < n.size(); ++i) {
+                n[i] = binary::attributeName(Attribute(i));
+            }
+            return n;
+        }();
+
+        auto r = binary::Record{};
+        auto timestamp = boost::log::extract<attrs::local_clock::value_type>(timestampName, rec);
+        if (timestamp) {
+            r.timestamp = (*timestamp - epoch).total_microseconds();
+        }
+        auto severity = boost::log::extract<int>(severityName, rec);
+        if (severity) {
+            r.severity = *severity;
+        }
+        boost::log::value_ref<std::string> values[binary::attributeCount];
+        for (size_t i = 0; i < binary::attributeCount; ++i) {
+            values[i] = boost::log::extract<std::string>(names[i], rec);
+            r.attributes[i] = values[i].get_ptr();
+        }
+        auto message = boost::log::extract<std::string>(messageName, rec);
+        r.message = message.get_ptr();
+
+        mEncoder.encode(mFile, r);
+        if (mAutoFlush) {
+            mFile.flush();
+        }
+    }
 
+    void flush () {
+        mFile.flush();
+    }
+
+private:
+    const fs::path mPath;
+    fs::ofstream mFile;
+    binary::Encoder mEncoder;
+    bool mAutoFlush = true;
+};
+
+struct InstalledSink {
+    boost::shared_ptr<sinks::sink> sink;
+    std::function<void()> stop;
+    // Stop and drain an asynchronous sink. Null for synchronous sinks.
+};
+
+std::vector<InstalledSink>& installedSinks () {
+    static std::vector<InstalledSink> sinks;
+    return sinks;
+}
+
+void reportDroppedRecords () {
+    static std::atomic<uint64_t> reported { 0 };
+    auto dropped = gDroppedRecords.load(std::memory_order_relaxed);
+    auto last = reported.exchange(dropped, std::memory_order_relaxed);
+    if (dropped > last) {
+        Logger lg;
+        BOOST_LOG_SEV(lg, static_cast<int>(Level::warning))
+            << "Dropped " << dropped - last << " log records: asynchronous sink queue full";
+    }
+}
+
+template <class Sink>
+void setDefaultFormatter (Sink& sink, std::true_type) {
+    sink.set_formatter(defaultFormatter());
+}
+
+template <class Sink>
+void setDefaultFormatter (Sink&, std::false_type) {}
+// Backends which do their own encoding take no formatter.
+
+template <class Backend>
+using IsFormatted = std::integral_constant<bool, sinks::has_requirement<
+    typename Backend::frontend_requirements, sinks::formatted_records>::value>;
+
+template <class Backend>
+void installSink (boost::shared_ptr<Backend> backend, std::function<void()> onIdle = {}) {
+    auto& settings = sinkSettings();
+    auto core = boost::log::core::get();
+
+    // With a flight recorder, every record gets past the core filter, so filter the others here.
+    auto filter = settings.flightRecorder.empty()
+        ? boost::log::filter{}
+        : boost::log::filter{&passesLevelFilter};
+
+    if (!settings.async) {
+        auto sink = boost::make_shared<sinks::synchronous_sink<Backend>>(backend);
+        sink->set_filter(filter);
+        setDefaultFormatter(*sink, IsFormatted<Backend>{});
+        core->add_sink(sink);
+        installedSinks().push_back({sink, {}});
+        return;
+    }
+
+    using Sink = sinks::asynchronous_sink<Backend, BoundedQueue>;
+    auto sink = boost::make_shared<Sink>(backend);
+    sink->set_filter(filter);
+    setDefaultFormatter(*sink, IsFormatted<Backend>{});
+    auto drop = settings.asyncOverflow == "drop";
+    sink->configure(settings.asyncQueueSize, drop,
+        std::chrono::milliseconds(settings.asyncFlushInterval),
+        [onIdle, drop] {
+            if (onIdle) { onIdle(); }
+            if (drop) { reportDroppedRecords(); }
+        });
+    core->add_sink(sink);
+    installedSinks().push_back({sink, [sink] {
+        sink->stop();
+        sink->flush();
+    }});
+}
+
+template <class Backend>
+void installStreamSink (boost::shared_ptr<Backend> backend) {
+    // File and console sinks: flush every record when synchronous, batch when asynchronous.
+    auto& settings = sinkSettings();
+    if (!settings.async) {
+        backend->auto_flush(true);
+        installSink(backend);
+        return;
+    }
+
+    backend->auto_flush(false);
+    auto batching = boost::make_shared<BatchingBackend<Backend>>(backend,
+        settings.asyncFlushSize, std::chrono::milliseconds(settings.asyncFlushInterval));
+    installSink(batching, [batching] { batching->flush(); });
+    // The idle callback runs on the sink's feeding thread, which is the only thread that
+    // consumes from the backend, so it needs no lock.
+}
+
+void removeSinks () {
+    auto core = boost::log::core::get();
+    auto& installed = installedSinks();
+    for (auto& s : installed) {
+        core->remove_sink(s.sink);
+        if (s.stop) {
+            s.stop();
+        }
+    }
+    installed.clear();
+}
+
+class CompressingCollector : public sinks::file::collector {
+    // Rotated log files are renamed to <file>.<time>-<seq>, then gzipped on a background thread
+    // to <file>.<time>-<seq>.gz. The backend calls `store_file()` while it holds the sink's lock,
+    // so it only does the rename; compression, and deletion of the oldest archives beyond
+    // `maxFiles`, never block a logging thread.
+
+public:
+    CompressingCollector (fs::path logFile, unsigned maxFiles)
+        : mLogFile(std::move(logFile))
+        , mMaxFiles(maxFiles)
+    {}
+
+    ~CompressingCollector () {
+        // Finish compressing whatever has been rotated so far.
+        {
+            std::lock_guard<std::mutex> lock {mMutex};
+            mStopped = true;
+            mReady.notify_one();
+        }
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    void store_file (const fs::path& src) override {
+        auto dst = archiveName();
+        auto ec = boost::system::error_code{};
+        fs::rename(src, dst, ec);
+        if (ec) {
+            // Leave it where it is. The backend will reopen and truncate it.
+            return;
+        }
+        std::lock_guard<std::mutex> lock {mMutex};
+        mPending.push_back(dst);
+        if (!mThread.joinable()) {
+            mThread = std::thread{[this] { run(); }};
+        }
+        mReady.notify_one();
+    }
+
+    uintmax_t scan_for_files (sinks::file::scan_method, const fs::path&, unsigned*) override {
+        return 0;
+    }
+
+private:
+    fs::path archiveName () {
+        // The sequence number starts over whenever the sinks are rebuilt, so skip any name already
+        // taken by an archive, compressed or not, from an earlier collector in the same second.
+        auto now = boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time());
+        while (true) {
+            auto name = std::ostringstream{};
+            name << mLogFile.filename().string() << '.' << now << '-'
+                 << std::setw(6) << std::setfill('0') << mSequence++;
+            auto path = mLogFile.parent_path() / name.str();
+            auto ec = boost::system::error_code{};
+            if (!fs::exists(path, ec) && !fs::exists(path.string() + ".gz", ec)) {
+                return path;
+            }
+        }
+    }
+
+    void run () {
+        auto lock = std::unique_lock<std::mutex>{mMutex};
+        while (true) {
+            mReady.wait(lock, [this] { return mStopped || !mPending.empty(); });
+            if (mPending.empty()) {
+                return;
+            }
+            auto path = mPending.front();
+            mPending.pop_front();
+            lock.unlock();
+            compress(path);
+            prune();
+            lock.lock();
+        }
+    }
+
+    void compress (const fs::path& path) {
+        auto gz = fs::path{path.string() + ".gz"};
+        auto tmp = fs::path{gz.string() + ".tmp"};
+        try {
+            {
+                fs::ifstream in {path, std::ios::binary};
+                fs::ofstream out {tmp, std::ios::binary};
+                out.exceptions(std::ios::badbit | std::ios::failbit);
+                boost::iostreams::filtering_ostream gzout;
+                gzout.push(boost::iostreams::gzip_compressor{});
+                gzout.push(out);
+                boost::iostreams::copy(in, gzout);
+            }
+            fs::rename(tmp, gz);
+            fs::remove(path);
+        }
+        catch (std::exception& e) {
+            auto ec = boost::system::error_code{};
+            fs::remove(tmp, ec);
+            BOOST_LOG_SEV(mLog, static_cast<int>(Level::error))
+                << "Could not compress rotated log file " << path.string() << ": " << e.what();
+        }
+    }
+
+    void prune () {
+        if (!mMaxFiles) {
+            return;
+        }
+        auto prefix = mLogFile.filename().string() + '.';
+        auto archives = std::vector<fs::path>{};
+        auto ec = boost::system::error_code{};
+        for (auto i = fs::directory_iterator{mLogFile.parent_path(), ec};
+                !ec && i != fs::directory_iterator{}; i.increment(ec)) {
+            auto name = i->path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) == 0
+                    && name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) {
+                archives.push_back(i->path());
+            }
+        }
+        if (archives.size() <= mMaxFiles) {
+            return;
+        }
+        // Archive names sort chronologically.
+        std::sort(archives.begin(), archives.end());
+        for (size_t i = 0; i < archives.size() - mMaxFiles; ++i) {
+            fs::remove(archives[i], ec);
+        }
+    }
+
+    const fs::path mLogFile;
+    const unsigned mMaxFiles;
+    unsigned mSequence = 0;
+    // Only touched by store_file(), which the backend serializes.
+
+    std::mutex mMutex;
+    std::condition_variable mReady;
+    std::deque<fs::path> mPending;
+    bool mStopped = false;
+    std::thread mThread;
+
+    Logger mLog;
+};
+
+fs::path prepareLogFile (const std::string& logFile) {
+    // Return the absolute path to the log file, having created its parent directories.
     auto absLogFile = fs::absolute(logFile);
     auto canonParentPath = fs::weakly_canonical(absLogFile.parent_path());
     // Canonicalize (make absolute without symlinks, '.', or '..') the parent path so we end
@@ -102,42 +985,136 @@ void initFileSink (const std::string& logFile) {
     else if (!fs::is_directory(canonParentPath)) {
         throw std::runtime_error{canonParentPath.string() + " is not a directory"};
     }
+    return canonParentPath / absLogFile.filename();
+}
 
-    namespace keywords = boost::log::keywords;
-    boost::log::add_file_log(
+void initFileSink (const std::string& logFile) {
+    auto absLogFile = prepareLogFile(logFile);
+    auto& settings = sinkSettings();
+    auto backend = boost::make_shared<sinks::text_file_backend>(
         keywords::file_name = absLogFile,
-        keywords::auto_flush = true
-    )->set_formatter(defaultFormatter());
-    boost::log::core::get()->set_logging_enabled(true);
+        keywords::auto_flush = !settings.async
+    );
+    if (settings.rotateSize || settings.rotateInterval) {
+        if (settings.rotateSize) {
+            backend->set_rotation_size(settings.rotateSize);
+        }
+        if (settings.rotateInterval) {
+            backend->set_time_based_rotation(sinks::file::rotation_at_time_interval(
+                boost::posix_time::seconds(settings.rotateInterval)));
+        }
+        backend->set_file_collector(boost::make_shared<CompressingCollector>(
+            absLogFile, settings.maxFiles));
+    }
+    installStreamSink(backend);
 }
 
-void initConsoleSink (bool enabled) {
-    if (!enabled) return;
-
-    namespace keywords = boost::log::keywords;
-    boost::log::add_console_log(
-        std::clog,
-        keywords::auto_flush = true
-    )->set_formatter(defaultFormatter());
-    boost::log::core::get()->set_logging_enabled(true);
+void initConsoleSink () {
+    auto backend = boost::make_shared<sinks::text_ostream_backend>();
+    backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+    installStreamSink(backend);
 }
 
 void initSyslogSink (const std::string& programName) {
-    if (!programName.size()) return;
-
-    namespace keywords = boost::log::keywords;
-    namespace sinks = boost::log::sinks;
+    auto& settings = sinkSettings();
+    // Boost.Log's name resolution only finds IPv4 addresses, so hand it literals as addresses.
+    auto ec = boost::system::error_code{};
+    auto address = boost::asio::ip::address::from_string(settings.syslogHost, ec);
+    auto isLiteral = !ec;
     auto backend = boost::make_shared<sinks::syslog_backend>(
         keywords::facility = sinks::syslog::user,
-        keywords::use_impl = sinks::syslog::native,
+        keywords::use_impl = settings.syslogHost.empty() ? sinks::syslog::native
+                                                         : sinks::syslog::udp_socket_based,
+        keywords::ip_version = isLiteral && address.is_v6() ? sinks::v6 : sinks::v4,
         keywords::ident = programName     // programname property in rsyslog
         );
-    using SyslogSink = sinks::synchronous_sink < sinks::syslog_backend > ;
-    auto sink = boost::make_shared<SyslogSink>(backend);
-    sink->set_formatter(defaultFormatter());
+    if (isLiteral) {
+        if (address.is_v6()) {
+            // Boost.Log would bind the socket to an IPv4 address.
+            backend->set_local_address(boost::asio::ip::address_v6::any(), 0);
+        }
+        backend->set_target_address(address, settings.syslogPort);
+    }
+    else if (!settings.syslogHost.empty()) {
+        backend->set_target_address(settings.syslogHost, settings.syslogPort);
+    }
+    installSink(backend);
+}
+
+boost::shared_ptr<BinaryFileBackend>& binaryFileBackend () {
+    // Kept across rebuilds of the sinks, so that notifying other options neither truncates the
+    // file nor breaks the encoder's string table, which only this backend's file has seen.
+    static boost::shared_ptr<BinaryFileBackend> backend;
+    return backend;
+}
+
+void initBinaryFileSink (const std::string& logFile) {
+    auto path = prepareLogFile(logFile);
+    auto& backend = binaryFileBackend();
+    if (!backend || backend->path() != path) {
+        backend.reset();
+        backend = boost::make_shared<BinaryFileBackend>(path);
+    }
+    backend->autoFlush(!sinkSettings().async);
+    installSink(backend, [backend] { backend->flush(); });
+}
 
+void initFlightRecorderSink (const std::string& dumpFile) {
+    auto& settings = sinkSettings();
+    auto trigger = settings.flightRecorderTrigger == "none"
+        ? FlightRecorderBackend::noTrigger
+        : parseLevel(settings.flightRecorderTrigger);
+    auto backend = boost::make_shared<FlightRecorderBackend>(
+        prepareLogFile(dumpFile).string(), settings.flightRecorderSize, trigger);
+    backend->handleFatalSignals();
+    // The recorder never formats and needs no frontend lock, even with --log-async.
+    auto sink = boost::make_shared<sinks::unlocked_sink<FlightRecorderBackend>>(backend);
     boost::log::core::get()->add_sink(sink);
-    boost::log::core::get()->set_logging_enabled(true);
+    installedSinks().push_back({sink, {}});
+
+    _::gRecordAllLevels.store(true, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock {gFlightRecorderMutex};
+    gFlightRecorder = backend;
+}
+
+void applySinkSettings () {
+    static auto registered = false;
+    if (!registered) {
+        // Asynchronous sinks may hold records which have not yet been written. Drain them on
+        // exit. Construct the sink list first, so it is destroyed after the handler runs.
+        installedSinks();
+        std::atexit(&removeSinks);
+        registered = true;
+    }
+
+    removeSinks();
+    _::gRecordAllLevels.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock {gFlightRecorderMutex};
+        gFlightRecorder.reset();
+    }
+
+    auto& settings = sinkSettings();
+    if (settings.file.size()) {
+        initFileSink(settings.file);
+    }
+    if (settings.console) {
+        initConsoleSink();
+    }
+    if (settings.syslog.size()) {
+        initSyslogSink(settings.syslog);
+    }
+    if (settings.binaryFile.size()) {
+        initBinaryFileSink(settings.binaryFile);
+    }
+    else {
+        binaryFileBackend().reset();
+    }
+    if (settings.flightRecorder.size()) {
+        initFlightRecorderSink(settings.flightRecorder);
+    }
+    boost::log::core::get()->set_logging_enabled(!installedSinks().empty());
 }
 
 } // anonymous namespace
@@ -0,0 +1,57 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "allocations.hpp"
+
+#include <atomic>
+#include <new>
+
+#include <cstdlib>
+
+namespace {
+    thread_local size_t gAllocations = 0;
+    std::atomic<size_t> gTotalAllocations {0};
+}
+
+namespace util { namespace test {
+
+size_t allocations () {
+    return gAllocations;
+}
+
+size_t totalAllocations () {
+    return gTotalAllocations.load(std::memory_order_relaxed);
+}
+
+}} // namespace util::test
+
+void* operator new (size_t size) {
+    ++gAllocations;
+    gTotalAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new[] (size_t size) {
+    return operator new(size);
+}
+
+void operator delete (void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[] (void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete (void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[] (void* p, size_t) noexcept {
+    std::free(p);
+}
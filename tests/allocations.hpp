@@ -0,0 +1,22 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef UTIL_TESTS_ALLOCATIONS_HPP
+#define UTIL_TESTS_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+namespace util { namespace test {
+
+size_t allocations ();
+// Number of calls to the global operator new made by the calling thread so far. Linking
+// allocations.cpp into a test executable replaces the global operator new and delete.
+
+size_t totalAllocations ();
+// Number of calls to the global operator new made by all threads so far.
+
+}} // namespace util::test
+
+#endif
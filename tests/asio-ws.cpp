@@ -6,11 +6,21 @@
 #include <util/doctest.h>
 
 #include <util/asio/iothread.hpp>
+#include <util/asio/iothreadpool.hpp>
 #include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/connectionpool.hpp>
 #include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/deflate.hpp>
+#include <util/asio/ws/shardedacceptor.hpp>
+#include <util/asio/ws/singlethreaded.hpp>
 
 #include <boost/asio/use_future.hpp>
 
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
 namespace ws = util::asio::ws;
 using boost::system::error_code;
 
@@ -90,3 +100,392 @@ TEST_CASE("WebSocket acceptor/connector test") {
     connector.close(ec);
     if (ec) { BOOST_LOG(lg) << "connector close: " << ec.message(); }
 }
+
+TEST_CASE("WebSocket sharded acceptor test") {
+    util::asio::IoThreadPool shards{2};
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::ShardedAcceptor{ioThread.context(), shards};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMqFuture = acceptor.asyncAccept(use_future);
+
+    auto connector = ws::Connector{ioThread.context()};
+    auto clientMq = ws::Connector::MessageQueue{ioThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+
+    auto serverMq = serverMqFuture.get();
+    REQUIRE(serverMq);
+    auto& serverContext = serverMq->get_io_service();
+    CHECK((&serverContext == &shards.context(0) || &serverContext == &shards.context(1)));
+
+    clientMq.asyncSend(boost::asio::buffer("Yo dawg"), use_future).get();
+    std::array<uint8_t, 1024> buffer;
+    auto nRxBytes = serverMq->asyncReceive(boost::asio::buffer(buffer), use_future).get();
+    CHECK(std::string(buffer.data(), buffer.data() + nRxBytes) == std::string("Yo dawg", 8));
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq->close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket send completion waits for the outbound buffer") {
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::Acceptor{ioThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::Acceptor::MessageQueue{ioThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::Connector{ioThread.context()};
+    auto clientMq = ws::Connector::MessageQueue{ioThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+
+    clientMq.setSendBufferLimit(0);
+
+    // Large enough that the kernel cannot take it all at once while nobody is receiving.
+    auto message = std::vector<uint8_t>(4 * 1024 * 1024, 'x');
+    auto sent = clientMq.asyncSend(boost::asio::buffer(message), use_future);
+    auto received = std::vector<uint8_t>(message.size());
+    auto nRxBytes = serverMq.asyncReceive(boost::asio::buffer(received), use_future).get();
+    sent.get();
+    CHECK(clientMq.getBufferedAmount() == 0);
+    CHECK(nRxBytes == message.size());
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket send completion waits while the peer is not reading") {
+    util::asio::IoThread serverThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = ws::Acceptor{serverThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::Acceptor::MessageQueue{serverThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::Connector{clientThread.context()};
+    auto clientMq = ws::Connector::MessageQueue{clientThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+
+    // Stall the server's thread, so nothing reads from the socket.
+    auto release = std::promise<void>{};
+    auto stalled = release.get_future().share();
+    serverThread.context().post([stalled] { stalled.wait(); });
+
+    // The first message is more than the kernel's socket buffers can hold, so its write stays in
+    // progress, and the second message stays in websocketpp's buffer behind it.
+    auto first = std::vector<uint8_t>(24 * 1024 * 1024, 'x');
+    auto second = std::vector<uint8_t>(1024 * 1024, 'y');
+    auto sentFirst = clientMq.asyncSend(boost::asio::buffer(first), use_future);
+    auto sentSecond = clientMq.asyncSend(boost::asio::buffer(second), use_future);
+    CHECK(sentSecond.wait_for(std::chrono::milliseconds(200)) == std::future_status::timeout);
+    CHECK(clientMq.getBufferedAmount() > clientMq.getSendBufferLimit());
+
+    release.set_value();
+    auto received = std::vector<uint8_t>(first.size());
+    CHECK(serverMq.asyncReceive(boost::asio::buffer(received), use_future).get() == first.size());
+    CHECK(serverMq.asyncReceive(boost::asio::buffer(received), use_future).get() == second.size());
+    sentFirst.get();
+    sentSecond.get();
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket zero-copy, dynamic buffer, and batch receive") {
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::Acceptor{ioThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::Acceptor::MessageQueue{ioThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::Connector{ioThread.context()};
+    auto clientMq = ws::Connector::MessageQueue{ioThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+
+    auto big = std::string(100000, 'y');
+    clientMq.asyncSend(boost::asio::buffer(big), use_future).get();
+    clientMq.asyncSend(boost::asio::buffer(big), use_future).get();
+
+    auto msg = serverMq.asyncReceiveMessage(use_future).get();
+    REQUIRE(msg);
+    CHECK(msg->get_payload() == big);
+
+    boost::asio::streambuf streambuf;
+    auto nRxBytes = serverMq.asyncReceive(streambuf, use_future).get();
+    CHECK(nRxBytes == big.size());
+    CHECK(streambuf.size() == big.size());
+
+    clientMq.setSendBufferLimit(0);
+    for (auto i = 0; i < 5; ++i) {
+        clientMq.asyncSend(boost::asio::buffer("burst"), use_future).get();
+    }
+    // The burst may reach the server in more than one read, so receive until all of it has
+    // arrived, checking that no batch exceeds its maximum.
+    auto messages = std::vector<ws::Acceptor::MessageQueue::MessagePtr>{};
+    while (messages.size() < 5) {
+        auto n = serverMq.asyncReceiveSome(messages, 3, use_future).get();
+        CHECK(n >= 1);
+        CHECK(n <= 3);
+    }
+    CHECK(messages.size() == 5);
+    for (auto& m : messages) {
+        CHECK(m->get_payload() == std::string("burst", 6));
+    }
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket sharded acceptor with SO_REUSEPORT listeners") {
+    util::asio::IoThreadPool shards{2};
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::ShardedAcceptor{ioThread.context(), shards};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0},
+        ws::ShardedAcceptor::ListenMode::reusePort);
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto connector = ws::Connector{ioThread.context()};
+    for (auto i = 0; i < 4; ++i) {
+        auto serverMqFuture = acceptor.asyncAccept(use_future);
+        auto clientMq = ws::Connector::MessageQueue{ioThread.context()};
+        connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+        auto serverMq = serverMqFuture.get();
+        REQUIRE(serverMq);
+
+        clientMq.asyncSend(boost::asio::buffer("Yo dawg"), use_future).get();
+        std::array<uint8_t, 1024> buffer;
+        auto nRxBytes = serverMq->asyncReceive(boost::asio::buffer(buffer), use_future).get();
+        CHECK(nRxBytes == 8);
+
+        auto ec = error_code{};
+        clientMq.close(ec);
+        serverMq->close(ec);
+    }
+
+    auto ec = error_code{};
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket permessage-deflate") {
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::DeflateAcceptor{ioThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::DeflateAcceptor::MessageQueue{ioThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::DeflateConnector{ioThread.context()};
+    auto clientMq = ws::DeflateConnector::MessageQueue{ioThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+    CHECK(clientMq.getExtensions().find("permessage-deflate") != std::string::npos);
+    CHECK(serverMq.getExtensions().find("permessage-deflate") != std::string::npos);
+
+    // One message above the compression threshold, one below.
+    auto messages = std::vector<std::string>{
+        std::string(10000, 'z'),
+        "short"
+    };
+    for (auto& m : messages) {
+        clientMq.asyncSend(boost::asio::buffer(m), use_future).get();
+        auto msg = serverMq.asyncReceiveMessage(use_future).get();
+        REQUIRE(msg);
+        CHECK(msg->get_payload() == m);
+    }
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket permessage-deflate is not negotiated with a plain peer") {
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::Acceptor{ioThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::Acceptor::MessageQueue{ioThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::DeflateConnector{ioThread.context()};
+    auto clientMq = ws::DeflateConnector::MessageQueue{ioThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+    CHECK(clientMq.getExtensions().empty());
+
+    auto message = std::string(10000, 'z');
+    clientMq.asyncSend(boost::asio::buffer(message), use_future).get();
+    auto msg = serverMq.asyncReceiveMessage(use_future).get();
+    REQUIRE(msg);
+    CHECK(msg->get_payload() == message);
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket single-threaded configs") {
+    util::asio::IoThread serverThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = ws::SingleThreadedAcceptor{serverThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = ws::SingleThreadedAcceptor::MessageQueue{serverThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = ws::SingleThreadedConnector{clientThread.context()};
+    auto clientMq = ws::SingleThreadedConnector::MessageQueue{clientThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+
+    // Initiated from this thread, but run on each queue's own io_service thread.
+    for (auto i = 0; i < 10; ++i) {
+        auto m = std::to_string(i);
+        clientMq.asyncSend(boost::asio::buffer(m), use_future).get();
+        auto msg = serverMq.asyncReceiveMessage(use_future).get();
+        REQUIRE(msg);
+        CHECK(msg->get_payload() == m);
+    }
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+TEST_CASE("WebSocket connection pool") {
+    util::asio::IoThreadPool shards{1};
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::ShardedAcceptor{ioThread.context(), shards};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto pool = ws::ConnectionPool{ioThread.context(), 1};
+    CHECK(pool.getWarmCount() == 1);
+    pool.warmUp("127.0.0.1", port);
+
+    // The warm connection is made before anyone asks for it. Mark it with a message.
+    auto warmServerMq = acceptor.asyncAccept(use_future).get();
+    REQUIRE(warmServerMq);
+    warmServerMq->asyncSend(boost::asio::buffer("warm"), use_future).get();
+    // The server's end can be open before the client's handshake completes.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.getReadyCount() < 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(pool.getReadyCount() >= 1);
+
+    auto clientMq = pool.asyncConnect("127.0.0.1", port, use_future).get();
+    REQUIRE(clientMq);
+    CHECK(clientMq->isOpen());
+    std::array<uint8_t, 1024> buffer;
+    auto nRxBytes = clientMq->asyncReceive(boost::asio::buffer(buffer), use_future).get();
+    CHECK(std::string(buffer.data(), buffer.data() + nRxBytes) == std::string("warm", 5));
+
+    // Handing out the warm connection starts its replacement.
+    auto replacementServerMq = acceptor.asyncAccept(use_future).get();
+    REQUIRE(replacementServerMq);
+
+    auto ec = error_code{};
+    clientMq->close(ec);
+    warmServerMq->close(ec);
+    replacementServerMq->close(ec);
+    pool.close(ec);
+    acceptor.close(ec);
+}
+
+TEST_CASE("WebSocket bulk connect") {
+    util::asio::IoThreadPool shards{2};
+    util::asio::IoThread ioThread;
+
+    auto acceptor = ws::ShardedAcceptor{ioThread.context(), shards};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    // Find a port with nothing listening on it.
+    auto closedPort = [&] {
+        boost::asio::ip::tcp::acceptor a{ioThread.context(),
+            {boost::asio::ip::address_v4::loopback(), 0}};
+        return std::to_string(a.local_endpoint().port());
+    }();
+
+    auto targets = std::vector<ws::ConnectTarget>(6, {"127.0.0.1", port});
+    targets[3].service = closedPort;
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto connector = ws::Connector{ioThread.context()};
+    auto results = connector.asyncConnectMany(targets, 2, use_future).get();
+    REQUIRE(results.size() == targets.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (i == 3) {
+            CHECK(results[i].ec);
+            CHECK(!results[i].mq);
+        }
+        else {
+            CHECK(!results[i].ec);
+            REQUIRE(results[i].mq);
+            CHECK(results[i].mq->isOpen());
+        }
+    }
+
+    auto ec = error_code{};
+    for (auto i = 0; i < 5; ++i) {
+        auto serverMq = acceptor.asyncAccept(use_future).get();
+        REQUIRE(serverMq);
+        serverMq->close(ec);
+    }
+    for (auto& result : results) {
+        if (result.mq) {
+            result.mq->close(ec);
+        }
+    }
+    acceptor.close(ec);
+    connector.close(ec);
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+
+#include "allocations.hpp"
+
+#include <util/asio/associatedlogger.hpp>
+#include <util/asio/asynccompletion.hpp>
+
+#include <boost/system/error_code.hpp>
+
+namespace {
+
+struct Handler {
+    bool* invoked;
+    void operator() (boost::system::error_code) { *invoked = true; }
+};
+
+} // anonymous namespace
+
+TEST_CASE("addAssociatedLoggerRef attaches a logger without allocating") {
+    util::log::Logger lg;
+    auto invoked = false;
+
+    using Token = decltype(util::asio::addAssociatedLoggerRef(Handler{&invoked}, lg));
+    using Signature = void(boost::system::error_code);
+
+    // No CHECKs between the two allocation counts: doctest may allocate.
+    util::log::Logger* associated = nullptr;
+    auto before = util::test::allocations();
+    {
+        util::asio::AsyncCompletion<Token, Signature> init {
+            util::asio::addAssociatedLoggerRef(Handler{&invoked}, lg)
+        };
+        auto copy = init.handler;
+        associated = &util::asio::getAssociatedLogger(copy);
+        copy(boost::system::error_code{});
+    }
+    auto after = util::test::allocations();
+
+    CHECK(after == before);
+    CHECK(associated == &lg);
+    CHECK(invoked);
+}
+
+TEST_CASE("addAssociatedLogger copies the logger") {
+    util::log::Logger lg;
+    auto invoked = false;
+
+    using Token = decltype(util::asio::addAssociatedLogger(Handler{&invoked}, lg));
+    using Signature = void(boost::system::error_code);
+
+    util::log::Logger* associated = nullptr;
+    auto before = util::test::allocations();
+    {
+        util::asio::AsyncCompletion<Token, Signature> init {
+            util::asio::addAssociatedLogger(Handler{&invoked}, lg)
+        };
+        associated = &util::asio::getAssociatedLogger(init.handler);
+    }
+    auto after = util::test::allocations();
+
+    CHECK(after > before);
+    CHECK(associated != &lg);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+
+#include <util/binarylog.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace util::log::binary;
+
+TEST_CASE("binary log records decode to the text format") {
+    std::stringstream file;
+    Encoder encoder;
+    encoder.writeHeader(file);
+
+    const std::string channel = "RPCSERVER";
+    const std::string endpoint = "127.0.0.1:42000";
+    const std::string requestId = "17";
+    const std::string message1 = "Received request";
+    const std::string message2 = "Sent reply";
+
+    auto rec = Record{};
+    rec.timestamp = 1476792723000042;  // 2016-10-18T12:12:03.000042
+    rec.attributes[size_t(Attribute::channel)] = &channel;
+    rec.attributes[size_t(Attribute::remoteEndpoint)] = &endpoint;
+    rec.attributes[size_t(Attribute::requestId)] = &requestId;
+    rec.message = &message1;
+    encoder.encode(file, rec);
+
+    auto sizeAfterFirst = file.str().size();
+    rec.timestamp += 1000000;
+    rec.message = &message2;
+    encoder.encode(file, rec);
+    // The attribute values are interned: the second record costs only its own frame.
+    CHECK(file.str().size() - sizeAfterFirst < 64);
+
+    Decoder decoder{file};
+    std::ostringstream text;
+    CHECK(decoder.next(text));
+    CHECK(decoder.next(text));
+    CHECK(!decoder.next(text));
+    CHECK(text.str() ==
+        "[2016-10-18T12:12:03.000042] RPCSERVER [127.0.0.1:42000] [RequestId=17] Received request\n"
+        "[2016-10-18T12:12:04.000042] RPCSERVER [127.0.0.1:42000] [RequestId=17] Sent reply\n");
+}
+
+TEST_CASE("binary log decoder rejects other files") {
+    std::istringstream file {"[2016-10-18T12:12:03.000042] not a binary log\n"};
+    CHECK_THROWS_AS(Decoder{file}, const std::runtime_error&);
+}
+
+TEST_CASE("binary log records stay intact when the interned string table wraps") {
+    std::stringstream file;
+    Encoder encoder;
+    encoder.writeHeader(file);
+
+    // Every record has a new RequestId, so the table fills up after the channel and
+    // maxInternedStrings - 1 of them, and the next record's values are interned after a reset.
+    const std::string channel = "CHAN";
+    const std::string message = "m";
+    auto n = Encoder::maxInternedStrings + 1;
+    for (size_t i = 0; i < n; ++i) {
+        auto requestId = "req" + std::to_string(i);
+        auto rec = Record{};
+        rec.attributes[size_t(Attribute::channel)] = &channel;
+        rec.attributes[size_t(Attribute::requestId)] = &requestId;
+        rec.message = &message;
+        encoder.encode(file, rec);
+    }
+
+    Decoder decoder{file};
+    std::ostringstream text;
+    auto lines = size_t{0};
+    while (decoder.next(text)) {
+        auto line = text.str();
+        auto expected = " CHAN [RequestId=req" + std::to_string(lines) + "] m\n";
+        REQUIRE(line.size() > expected.size());
+        CHECK(line.compare(line.size() - expected.size(), expected.size(), expected) == 0);
+        text.str("");
+        ++lines;
+    }
+    CHECK(lines == n);
+}
+
+TEST_CASE("binary log decoder rejects oversized frames") {
+    std::stringstream file;
+    Encoder encoder;
+    encoder.writeHeader(file);
+    file.write("\xff\xff\xff\xff", 4);
+    Decoder decoder{file};
+    std::ostringstream text;
+    CHECK_THROWS_AS(decoder.next(text), const std::runtime_error&);
+}
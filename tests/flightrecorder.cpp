@@ -0,0 +1,124 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+
+#include <util/flightrecorder.hpp>
+#include <util/log.hpp>
+
+#include <boost/log/core.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/program_options.hpp>
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+TEST_CASE("flight recorder keeps the last records of each thread") {
+    auto path = fs::temp_directory_path() / fs::unique_path();
+    auto backend = boost::make_shared<util::log::FlightRecorderBackend>(
+        path.string(), 3, util::log::Level::error);
+    auto sink = boost::make_shared<boost::log::sinks::unlocked_sink<
+        util::log::FlightRecorderBackend>>(backend);
+    boost::log::core::get()->add_sink(sink);
+
+    auto read = [&path] {
+        fs::ifstream in {path};
+        return std::string{std::istreambuf_iterator<char>{in}, {}};
+    };
+
+    util::log::Logger lg {util::log::channel = "FLIGHT"};
+    for (auto i = 0; i < 5; ++i) {
+        BOOST_LOG(lg) << "record " << i;
+    }
+
+    CHECK(backend->dump("test"));
+    auto dump = read();
+    CHECK(dump.find("flight recorder dump: test") != std::string::npos);
+    CHECK(dump.find("record 1") == std::string::npos);
+    CHECK(dump.find("info FLIGHT record 2") != std::string::npos);
+    CHECK(dump.find("info FLIGHT record 4") != std::string::npos);
+
+    UTIL_LOG_ERROR(lg) << "trigger";
+    dump = read();
+    CHECK(dump.find("flight recorder dump: trigger level") != std::string::npos);
+    CHECK(dump.find("error FLIGHT trigger") != std::string::npos);
+
+    // The trigger is latched until the next dump().
+    UTIL_LOG_ERROR(lg) << "latched";
+    CHECK(read().find("latched") == std::string::npos);
+    CHECK(backend->dump("test"));
+    UTIL_LOG_ERROR(lg) << "re-armed";
+    dump = read();
+    CHECK(dump.find("flight recorder dump: trigger level") != std::string::npos);
+    CHECK(dump.find("error FLIGHT re-armed") != std::string::npos);
+
+    boost::log::core::get()->remove_sink(sink);
+    fs::remove(path);
+}
+
+TEST_CASE("flight recorders alive at once keep one ring per thread each") {
+    using Sink = boost::log::sinks::unlocked_sink<util::log::FlightRecorderBackend>;
+    auto path1 = fs::temp_directory_path() / fs::unique_path();
+    auto path2 = fs::temp_directory_path() / fs::unique_path();
+    auto backend1 = boost::make_shared<util::log::FlightRecorderBackend>(
+        path1.string(), 8, util::log::FlightRecorderBackend::noTrigger);
+    auto backend2 = boost::make_shared<util::log::FlightRecorderBackend>(
+        path2.string(), 8, util::log::FlightRecorderBackend::noTrigger);
+    auto sink1 = boost::make_shared<Sink>(backend1);
+    auto sink2 = boost::make_shared<Sink>(backend2);
+    boost::log::core::get()->add_sink(sink1);
+    boost::log::core::get()->add_sink(sink2);
+
+    util::log::Logger lg;
+    for (auto i = 0; i < 4; ++i) {
+        BOOST_LOG(lg) << "record " << i;
+    }
+
+    CHECK(backend1->dump("test"));
+    fs::ifstream in {path1};
+    auto dump = std::string{std::istreambuf_iterator<char>{in}, {}};
+    CHECK(dump.find("--- thread ring 0 ---") != std::string::npos);
+    CHECK(dump.find("--- thread ring 1 ---") == std::string::npos);
+    CHECK(dump.find("record 0") != std::string::npos);
+    CHECK(dump.find("record 3") != std::string::npos);
+
+    boost::log::core::get()->remove_sink(sink1);
+    boost::log::core::get()->remove_sink(sink2);
+    fs::remove(path1);
+    fs::remove(path2);
+}
+
+TEST_CASE("flight recorder keeps records below --log-level") {
+    namespace po = boost::program_options;
+    auto path = fs::temp_directory_path() / fs::unique_path();
+    auto pathOption = "--log-flight-recorder=" + path.string();
+
+    auto parse = [](std::vector<const char*> args) {
+        args.insert(args.begin(), "test");
+        po::variables_map vm;
+        po::store(po::parse_command_line(int(args.size()), args.data(),
+            util::log::optionsDescription()), vm);
+        po::notify(vm);
+    };
+
+    parse({pathOption.c_str(), "--log-level=warning"});
+    util::log::Logger lg {util::log::channel = "FLIGHT"};
+    UTIL_LOG_DEBUG(lg) << "below the level";
+    CHECK(util::log::dumpFlightRecorder());
+    fs::ifstream in {path};
+    auto dump = std::string{std::istreambuf_iterator<char>{in}, {}};
+    CHECK(dump.find("debug FLIGHT below the level") != std::string::npos);
+
+    // Back to the sinks tests/main.cpp set up, and the default level.
+    parse({"--log-flight-recorder", ""});
+    CHECK(!util::log::dumpFlightRecorder());
+    fs::remove(path);
+}
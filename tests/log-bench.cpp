@@ -0,0 +1,211 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure what logging costs the logging thread, for each sink `util::log::optionsDescription()`
+// can configure, with 1, 2, 4, ... threads and finally N. Each thread logs records with a channel,
+// a RemoteEndpoint, and a RequestId, like our RPC and WebSocket code does. For each
+// configuration, report total records/sec, the p50 and p99 latency of one BOOST_LOG statement on
+// the calling thread, and the number of allocations per record made on the calling thread.
+// Asynchronous sinks do their work on another thread, so that work shows up only in records/sec,
+// once their queues fill.
+//
+// The console sink writes to a discarding std::clog, files go to a temporary directory, and
+// syslog goes over UDP to a local socket standing in for a syslog daemon.
+//
+// Usage: log-bench [records-per-thread [max-threads]]
+
+#include "allocations.hpp"
+
+#include <util/log.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/log/attributes/constant.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+struct NullBuffer : std::streambuf {
+    int overflow (int c) override { return c; }
+    std::streamsize xsputn (const char*, std::streamsize n) override { return n; }
+};
+
+struct Result {
+    double recordsPerSecond;
+    double p50;
+    double p99;
+    double allocationsPerRecord;
+};
+
+void configure (po::options_description& desc, const std::map<std::string, std::string>& args) {
+    // Sinks are rebuilt on every notify, so each configuration starts from scratch. Pass every
+    // option we vary, so the previous configuration's values are overwritten.
+    auto options = std::map<std::string, std::string>{
+        { "--log-console", "0" },
+        { "--log-async", "0" },
+        { "--log-async-overflow", "block" },
+        { "--log-file", "" },
+        { "--log-binary-file", "" },
+        { "--log-syslog", "" },
+        { "--log-flight-recorder", "" },
+    };
+    for (auto& arg : args) {
+        options[arg.first] = arg.second;
+    }
+    auto argv = std::vector<const char*>{"log-bench"};
+    for (auto& option : options) {
+        argv.push_back(option.first.c_str());
+        argv.push_back(option.second.c_str());
+    }
+    po::variables_map vm;
+    po::store(po::parse_command_line(int(argv.size()), argv.data(), desc), vm);
+    po::notify(vm);
+}
+
+Result run (size_t threads, size_t records) {
+    auto latencies = std::vector<std::vector<double>>(threads);
+    auto allocations = std::vector<size_t>(threads);
+
+    auto work = [&](size_t t) {
+        util::log::Logger lg {util::log::channel = "BENCH"};
+        lg.add_attribute("RemoteEndpoint",
+            boost::log::attributes::constant<std::string>("127.0.0.1:42000"));
+        lg.add_attribute("RequestId",
+            boost::log::attributes::constant<std::string>(std::to_string(t)));
+        auto& lat = latencies[t];
+        lat.reserve(records);
+
+        auto before = util::test::allocations();
+        for (size_t i = 0; i < records; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            BOOST_LOG(lg) << "Received " << i << " byte message from thread " << t;
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            lat.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+        }
+        allocations[t] = util::test::allocations() - before;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto pool = std::vector<std::thread>{};
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back(work, t);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    auto all = std::vector<double>{};
+    for (auto& lat : latencies) {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto total = threads * records;
+    auto allocs = size_t(0);
+    for (auto a : allocations) {
+        allocs += a;
+    }
+    return {
+        total / elapsed.count(),
+        all[all.size() / 2],
+        all[all.size() * 99 / 100],
+        double(allocs) / total
+    };
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t records = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+        : std::max(1u, std::thread::hardware_concurrency());
+    if (!records || !maxThreads) {
+        // There would be no latencies to take percentiles of.
+        std::cerr << "records-per-thread and max-threads must be at least 1\n";
+        return 1;
+    }
+
+    NullBuffer nullBuffer;
+    auto clogBuffer = std::clog.rdbuf(&nullBuffer);
+
+    auto dir = fs::temp_directory_path() / fs::unique_path("log-bench-%%%%%%%%");
+    fs::create_directories(dir);
+
+    boost::asio::io_service context;
+    boost::asio::ip::udp::socket syslogd {context,
+        boost::asio::ip::udp::endpoint{boost::asio::ip::address_v4::loopback(), 0}};
+    syslogd.set_option(boost::asio::socket_base::receive_buffer_size(1 << 20));
+    // Nothing reads from the stand-in: the kernel discards datagrams once its buffer is full,
+    // just as a syslog daemon which cannot keep up would lose them.
+    auto syslogAddress = "127.0.0.1:" + std::to_string(syslogd.local_endpoint().port());
+
+    auto file = (dir / "bench.log").string();
+    auto binaryFile = (dir / "bench.bin").string();
+    auto flightRecorder = (dir / "flight.txt").string();
+
+    struct Configuration {
+        const char* name;
+        std::map<std::string, std::string> args;
+    };
+    auto configurations = std::vector<Configuration>{
+        { "no sinks", {} },
+        { "console", { { "--log-console", "1" } } },
+        { "file", { { "--log-file", file } } },
+        { "file, async", { { "--log-file", file }, { "--log-async", "1" } } },
+        { "file, async, drop", { { "--log-file", file }, { "--log-async", "1" },
+            { "--log-async-overflow", "drop" } } },
+        { "binary file", { { "--log-binary-file", binaryFile } } },
+        { "syslog (UDP)", { { "--log-syslog", "log-bench" },
+            { "--log-syslog-address", syslogAddress } } },
+        { "flight recorder", { { "--log-flight-recorder", flightRecorder } } },
+    };
+
+    auto desc = util::log::optionsDescription(util::log::ConsoleDefault::OFF);
+
+    std::cout << std::left << std::setw(20) << "sinks" << std::right
+              << std::setw(8) << "threads"
+              << std::setw(14) << "records/s"
+              << std::setw(10) << "p50 ns"
+              << std::setw(10) << "p99 ns"
+              << std::setw(14) << "allocs/rec" << '\n';
+
+    for (auto& c : configurations) {
+        for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            configure(desc, c.args);
+            auto r = run(threads, records);
+            configure(desc, {});
+            // Drain asynchronous sinks before the next configuration.
+
+            std::cout << std::left << std::setw(20) << c.name << std::right
+                      << std::setw(8) << threads
+                      << std::setw(14) << std::fixed << std::setprecision(0) << r.recordsPerSecond
+                      << std::setw(10) << r.p50
+                      << std::setw(10) << r.p99
+                      << std::setw(14) << std::setprecision(2) << r.allocationsPerRecord << '\n';
+            if (threads == maxThreads) {
+                break;
+            }
+        }
+    }
+
+    std::clog.rdbuf(clogBuffer);
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+#include <util/binarylog.hpp>
+#include <util/log.hpp>
+#include <util/logratelimit.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+using util::log::Level;
+
+TEST_CASE("UTIL_LOG_* call sites are filtered before the record is opened") {
+    util::log::Logger lg;
+    util::log::Logger chatty {util::log::channel = "chatty"};
+
+    auto evaluated = 0;
+    auto touch = [&evaluated] { return ++evaluated; };
+
+    util::log::setLevel(Level::info);
+    UTIL_LOG_DEBUG(lg) << touch();
+    CHECK(evaluated == 0);
+    UTIL_LOG_INFO(lg) << touch();
+    CHECK(evaluated == 1);
+
+    util::log::setChannelLevel("chatty", Level::error);
+    CHECK(util::log::enabled(lg, Level::info));
+    CHECK(!util::log::enabled(chatty, Level::warning));
+    CHECK(util::log::enabled(chatty, Level::error));
+    UTIL_LOG_WARNING(chatty) << touch();
+    CHECK(evaluated == 1);
+
+    util::log::clearChannelLevels();
+    util::log::setLevel(Level::trace);
+    CHECK(util::log::enabled(chatty, Level::trace));
+}
+
+TEST_CASE("UTIL_LOG_RATE_LIMITED suppresses records beyond the burst") {
+    util::log::Logger lg;
+
+    auto evaluated = 0;
+    auto touch = [&evaluated] { return ++evaluated; };
+
+    for (auto i = 0; i < 10; ++i) {
+        UTIL_LOG_RATE_LIMITED(lg, Level::info, 0.001, 3) << touch();
+    }
+    CHECK(evaluated == 3);
+
+    util::log::RateLimit limit {0.001, 1};
+    UTIL_LOG_LIMITED_BY(limit, lg, Level::info) << touch();
+    UTIL_LOG_LIMITED_BY(limit, lg, Level::info) << touch();
+    CHECK(evaluated == 4);
+    CHECK(limit.totalSuppressed() == 1);
+
+    util::log::setLevel(Level::warning);
+    UTIL_LOG_LIMITED_BY(limit, lg, Level::info) << touch();
+    CHECK(limit.totalSuppressed() == 1);
+    util::log::setLevel(Level::trace);
+}
+
+TEST_CASE("RateLimit logs a pending summary when it is destroyed") {
+    namespace expr = boost::log::expressions;
+    using Sink = boost::log::sinks::synchronous_sink<boost::log::sinks::text_ostream_backend>;
+    auto out = boost::make_shared<std::ostringstream>();
+    auto sink = boost::make_shared<Sink>();
+    sink->locked_backend()->add_stream(out);
+    sink->set_formatter(
+        expr::stream << expr::attr<std::string>("Channel") << ": " << expr::smessage);
+    boost::log::core::get()->add_sink(sink);
+
+    util::log::Logger lg {util::log::channel = "LIMITED"};
+    {
+        util::log::RateLimit limit {0.001, 1};
+        for (auto i = 0; i < 3; ++i) {
+            UTIL_LOG_LIMITED_BY(limit, lg, Level::info) << "record " << i;
+        }
+        CHECK(out->str().find("Suppressed") == std::string::npos);
+    }
+    sink->flush();
+    CHECK(out->str().find("LIMITED: record 0\n") != std::string::npos);
+    CHECK(out->str().find("LIMITED: Suppressed 2 similar messages\n") != std::string::npos);
+
+    boost::log::core::get()->remove_sink(sink);
+}
+
+TEST_CASE("--log-level and --log-filter replace the levels") {
+    namespace po = boost::program_options;
+    util::log::Logger lg;
+    util::log::Logger ws {util::log::channel = "WS++"};
+
+    auto parse = [](std::vector<const char*> args) {
+        args.insert(args.begin(), "test");
+        po::variables_map vm;
+        po::store(po::parse_command_line(int(args.size()), args.data(),
+            util::log::levelOptionsDescription()), vm);
+        po::notify(vm);
+    };
+
+    parse({"--log-level=info", "--log-filter", "WS++=error"});
+    CHECK(!util::log::enabled(lg, Level::debug));
+    CHECK(util::log::enabled(lg, Level::info));
+    CHECK(!util::log::enabled(ws, Level::warning));
+    CHECK(util::log::enabled(ws, Level::error));
+
+    parse({});
+    CHECK(util::log::enabled(lg, Level::trace));
+    CHECK(util::log::enabled(ws, Level::trace));
+
+    CHECK_THROWS_AS(parse({"--log-filter=WS++"}), const po::validation_error&);
+    CHECK_THROWS_AS(parse({"--log-level=loud"}), const po::validation_error&);
+    util::log::setLevel(Level::trace);
+}
+
+TEST_CASE("--log-syslog-address accepts IPv6 and rejects bad ports") {
+    namespace po = boost::program_options;
+    auto parse = [](const char* address) {
+        std::vector<const char*> args {"test", "--log-syslog-address", address};
+        po::variables_map vm;
+        po::store(po::parse_command_line(int(args.size()), args.data(),
+            util::log::optionsDescription()), vm);
+        po::notify(vm);
+    };
+
+    CHECK_NOTHROW(parse("localhost"));
+    CHECK_NOTHROW(parse("127.0.0.1:5514"));
+    CHECK_NOTHROW(parse("::1"));
+    CHECK_NOTHROW(parse("[::1]:5514"));
+    CHECK_THROWS_AS(parse("localhost:65536"), const po::validation_error&);
+    CHECK_THROWS_AS(parse("localhost:syslog"), const po::validation_error&);
+    CHECK_THROWS_AS(parse("localhost:"), const po::validation_error&);
+    CHECK_THROWS_AS(parse("[::1"), const po::validation_error&);
+    CHECK_THROWS_AS(parse("::1:x"), const po::validation_error&);
+    // Back to the local syslog, which no test uses.
+    parse("");
+}
+
+TEST_CASE("notifying other options keeps the binary log written so far") {
+    namespace po = boost::program_options;
+    auto path = fs::temp_directory_path() / fs::unique_path();
+    auto pathOption = "--log-binary-file=" + path.string();
+
+    auto parse = [](std::vector<const char*> args) {
+        args.insert(args.begin(), "test");
+        po::variables_map vm;
+        po::store(po::parse_command_line(int(args.size()), args.data(),
+            util::log::optionsDescription()), vm);
+        po::notify(vm);
+    };
+
+    util::log::Logger lg {util::log::channel = "BINARY"};
+    parse({pathOption.c_str()});
+    BOOST_LOG(lg) << "first";
+    parse({pathOption.c_str(), "--log-async=1"});
+    BOOST_LOG(lg) << "second";
+
+    // Back to the sinks tests/main.cpp set up. This drains the asynchronous sink.
+    parse({"--log-binary-file", ""});
+
+    fs::ifstream in {path, std::ios::binary};
+    util::log::binary::Decoder decoder {in};
+    std::ostringstream text;
+    while (decoder.next(text)) {}
+    CHECK(text.str().find("BINARY first") != std::string::npos);
+    CHECK(text.str().find("BINARY second") != std::string::npos);
+    fs::remove(path);
+}
+
+namespace {
+
+void parseLogOptions (std::vector<const char*> args) {
+    namespace po = boost::program_options;
+    args.insert(args.begin(), "test");
+    po::variables_map vm;
+    po::store(po::parse_command_line(int(args.size()), args.data(),
+        util::log::optionsDescription()), vm);
+    po::notify(vm);
+}
+
+std::vector<fs::path> rotatedArchives (const fs::path& dir) {
+    auto archives = std::vector<fs::path>{};
+    for (auto i = fs::directory_iterator{dir}; i != fs::directory_iterator{}; ++i) {
+        if (i->path().extension() == ".gz") {
+            archives.push_back(i->path());
+        }
+    }
+    std::sort(archives.begin(), archives.end());
+    return archives;
+}
+
+std::string gunzip (const fs::path& path) {
+    fs::ifstream in {path, std::ios::binary};
+    boost::iostreams::filtering_istream gzin;
+    gzin.push(boost::iostreams::gzip_decompressor{});
+    gzin.push(in);
+    return std::string{std::istreambuf_iterator<char>{gzin}, {}};
+}
+
+} // anonymous namespace
+
+TEST_CASE("--log-rotate-size rotates into gzipped archives") {
+    auto dir = fs::temp_directory_path() / fs::unique_path();
+    auto fileOption = "--log-file=" + (dir / "test.log").string();
+
+    util::log::Logger lg {util::log::channel = "ROTATE"};
+    parseLogOptions({fileOption.c_str(), "--log-console=0", "--log-rotate-size=1024"});
+    for (auto i = 0; i < 100; ++i) {
+        BOOST_LOG(lg) << "record " << i;
+    }
+    // Back to the sinks tests/main.cpp set up. The collector finishes compressing first.
+    parseLogOptions({"--log-file", ""});
+
+    auto archives = rotatedArchives(dir);
+    CHECK(archives.size() > 1);
+    auto text = std::string{};
+    const std::regex name {R"(test\.log\.\d{8}T\d{6}-\d{6}\.gz)"};
+    for (auto& archive : archives) {
+        CHECK(std::regex_match(archive.filename().string(), name));
+        fs::ifstream in {archive, std::ios::binary};
+        char header[2] = {};
+        in.read(header, sizeof(header));
+        CHECK(uint8_t(header[0]) == 0x1f);
+        CHECK(uint8_t(header[1]) == 0x8b);
+        text += gunzip(archive);
+    }
+    CHECK(text.find("ROTATE record 0\n") != std::string::npos);
+    CHECK(text.find("ROTATE record 99\n") != std::string::npos);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("--log-max-files keeps only the newest archives") {
+    auto dir = fs::temp_directory_path() / fs::unique_path();
+    auto fileOption = "--log-file=" + (dir / "test.log").string();
+
+    util::log::Logger lg {util::log::channel = "ROTATE"};
+    parseLogOptions({fileOption.c_str(), "--log-console=0", "--log-rotate-size=1024",
+        "--log-max-files=2"});
+    for (auto i = 0; i < 100; ++i) {
+        BOOST_LOG(lg) << "record " << i;
+    }
+    parseLogOptions({"--log-file", ""});
+
+    auto archives = rotatedArchives(dir);
+    CHECK(archives.size() == 2);
+    auto text = std::string{};
+    for (auto& archive : archives) {
+        text += gunzip(archive);
+    }
+    CHECK(text.find("ROTATE record 0\n") == std::string::npos);
+    CHECK(text.find("ROTATE record 99\n") != std::string::npos);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("rebuilding the file sink keeps earlier archives") {
+    auto dir = fs::temp_directory_path() / fs::unique_path();
+    auto fileOption = "--log-file=" + (dir / "test.log").string();
+
+    // The rebuilt sink's collector numbers its archives from zero again, usually within the same
+    // second as the first collector's.
+    util::log::Logger lg {util::log::channel = "ROTATE"};
+    for (auto pass : {"first", "second"}) {
+        parseLogOptions({fileOption.c_str(), "--log-console=0", "--log-rotate-size=1024"});
+        for (auto i = 0; i < 50; ++i) {
+            BOOST_LOG(lg) << pass << " record " << i;
+        }
+    }
+    parseLogOptions({"--log-file", ""});
+
+    auto text = std::string{};
+    for (auto& archive : rotatedArchives(dir)) {
+        text += gunzip(archive);
+    }
+    for (auto pass : {"first", "second"}) {
+        for (auto i = 0; i < 50; ++i) {
+            auto record = std::string{"ROTATE "} + pass + " record " + std::to_string(i) + '\n';
+            CHECK(text.find(record) != std::string::npos);
+        }
+    }
+    fs::remove_all(dir);
+}
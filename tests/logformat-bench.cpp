@@ -0,0 +1,81 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure how many records per second a sink frontend can format with `defaultFormatter()`, and
+// with a formatter that renders only the LogSafely timestamp. The backend discards the formatted
+// string, so no I/O is involved.
+//
+// Usage: logformat-bench [records]
+
+#include <util/log.hpp>
+#include <util/logsafely.hpp>
+
+#include <boost/log/attributes/clock.hpp>
+#include <boost/log/attributes/constant.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct NullBackend : boost::log::sinks::basic_formatted_sink_backend<char> {
+    void consume (const boost::log::record_view&, const string_type& formatted) {
+        bytes += formatted.size();
+    }
+
+    size_t bytes = 0;
+};
+
+double recordsPerSecond (boost::log::formatter formatter, size_t records) {
+    auto core = boost::log::core::get();
+    auto backend = boost::make_shared<NullBackend>();
+    auto sink = boost::make_shared<boost::log::sinks::synchronous_sink<NullBackend>>(backend);
+    sink->set_formatter(formatter);
+    core->add_sink(sink);
+
+    util::log::Logger lg{util::log::channel = "BENCH"};
+    lg.add_attribute("RemoteEndpoint",
+        boost::log::attributes::constant<std::string>("127.0.0.1:42000"));
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records; ++i) {
+        BOOST_LOG(lg) << "Received " << i << " byte message";
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    core->remove_sink(sink);
+    return records / std::chrono::duration<double>(elapsed).count();
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t records = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    boost::log::core::get()->add_global_attribute("TimeStamp",
+        boost::log::attributes::local_clock());
+
+    namespace expr = boost::log::expressions;
+    auto timestampOnly = boost::log::formatter{expr::stream
+        << expr::attr<boost::log::attributes::local_clock::value_type, util::LogSafely>(
+            "TimeStamp")};
+
+    // Warm up the allocator and caches.
+    recordsPerSecond(util::log::defaultFormatter(), records / 10 + 1);
+
+    auto full = recordsPerSecond(util::log::defaultFormatter(), records);
+    auto timestamp = recordsPerSecond(timestampOnly, records);
+
+    std::cout << "records:                 " << records << '\n'
+              << "defaultFormatter:        " << full << " records/s\n"
+              << "timestamp only:          " << timestamp << " records/s\n";
+    return 0;
+}
@@ -33,3 +33,18 @@ TEST_CASE("ProducerConsumerQueue") {
         CHECK(pcq.depth() == (produces - consumes));
     }
 }
+
+TEST_CASE("ProducerConsumerQueue tryConsume") {
+    util::ProducerConsumerQueue<int> pcq;
+    auto value = 0;
+    CHECK(!pcq.tryConsume([&](int i) { value = i; }));
+    CHECK(pcq.depth() == 0);
+    pcq.produce(1);
+    pcq.produce(2);
+    REQUIRE(pcq.front());
+    CHECK(std::get<0>(*pcq.front()) == 1);
+    CHECK(pcq.tryConsume([&](int i) { value = i; }));
+    CHECK(value == 1);
+    CHECK(pcq.depth() == 1);
+    CHECK(std::get<0>(*pcq.front()) == 2);
+}
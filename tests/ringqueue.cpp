@@ -0,0 +1,47 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+#include <util/ringqueue.hpp>
+
+#include "allocations.hpp"
+
+#include <memory>
+#include <string>
+
+TEST_CASE("RingQueue allocates nothing until it is used") {
+    auto before = util::test::allocations();
+    util::RingQueue<std::string> q;
+    CHECK(q.empty());
+    CHECK(q.capacity() == 0);
+    CHECK(util::test::allocations() == before);
+}
+
+TEST_CASE("RingQueue is FIFO across growth and wraparound") {
+    util::RingQueue<std::unique_ptr<int>> q;
+    auto next = 0;
+    auto expected = 0;
+    // Interleave pushes and pops so the head wraps while the buffer grows.
+    for (auto round = 0; round < 10; ++round) {
+        for (auto i = 0; i < round + 3; ++i) {
+            q.push(std::make_unique<int>(next++));
+        }
+        for (auto i = 0; i < 2; ++i) {
+            REQUIRE(!q.empty());
+            CHECK(*q.front() == expected++);
+            q.pop();
+        }
+    }
+    CHECK(q.size() == size_t(next - expected));
+    CHECK((q.capacity() & (q.capacity() - 1)) == 0);
+
+    auto moved = std::move(q);
+    CHECK(q.empty());
+    while (!moved.empty()) {
+        CHECK(*moved.front() == expected++);
+        moved.pop();
+    }
+    CHECK(expected == next);
+}
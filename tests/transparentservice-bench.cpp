@@ -0,0 +1,116 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure the overhead of an asynchronous call through a TransparentIoObject, with and without
+// the OperationCounter lightweight handler mode. Each iteration initiates an operation whose
+// implementation completes immediately, so the numbers are dominated by token transformation,
+// handler copies, and the completion dispatch.
+//
+// Usage: transparentservice-bench [iterations]
+
+#include <util/asio/asynccompletion.hpp>
+#include <util/asio/transparentservice.hpp>
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+template <class Base>
+struct NoopImplBase : Base {
+    explicit NoopImplBase (boost::asio::io_service& context)
+        : Base(context)
+        , mContext(context)
+    {}
+
+    void close (boost::system::error_code& ec) { ec = {}; }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+    asyncNoop (CompletionToken&& token) {
+        util::asio::AsyncCompletion<
+            CompletionToken, void(boost::system::error_code)
+        > init { std::forward<CompletionToken>(token) };
+
+        mContext.post([handler = std::move(init.handler)]() mutable {
+            handler(boost::system::error_code{});
+        });
+
+        return init.result.get();
+    }
+
+    boost::asio::io_service& mContext;
+};
+
+struct NoBase {
+    explicit NoBase (boost::asio::io_service&) {}
+};
+
+struct DefaultImpl : NoopImplBase<NoBase> {
+    using NoopImplBase<NoBase>::NoopImplBase;
+};
+
+struct CountedImpl : NoopImplBase<util::asio::OperationCounter> {
+    using NoopImplBase<util::asio::OperationCounter>::NoopImplBase;
+};
+
+template <class Impl>
+struct Noop : util::asio::TransparentIoObject<Impl> {
+    explicit Noop (boost::asio::io_service& context)
+        : util::asio::TransparentIoObject<Impl>(context)
+    {}
+
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncNoop)
+};
+
+template <class Impl>
+struct Loop {
+    // Initiate the next operation from the completion handler of the previous one.
+    Noop<Impl>& noop;
+    size_t& remaining;
+
+    void operator() (boost::system::error_code) {
+        if (remaining--) {
+            noop.asyncNoop(*this);
+        }
+    }
+};
+
+template <class Impl>
+double nsPerCall (size_t iterations) {
+    boost::asio::io_service context;
+    Noop<Impl> noop{context};
+    auto remaining = iterations;
+
+    auto start = std::chrono::steady_clock::now();
+    noop.asyncNoop(Loop<Impl>{noop, remaining});
+    context.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+        / iterations;
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    // Warm up the allocator and caches.
+    nsPerCall<DefaultImpl>(iterations / 10 + 1);
+    nsPerCall<CountedImpl>(iterations / 10 + 1);
+
+    auto dflt = nsPerCall<DefaultImpl>(iterations);
+    auto counted = nsPerCall<CountedImpl>(iterations);
+
+    std::cout << "iterations:                " << iterations << '\n'
+              << "default handler:           " << dflt << " ns/call\n"
+              << "OperationCounter handler:  " << counted << " ns/call\n";
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <util/doctest.h>
+
+#include <util/asio/asynccompletion.hpp>
+#include <util/asio/transparentservice.hpp>
+
+#include <boost/asio/io_service.hpp>
+
+#include <memory>
+
+namespace {
+
+struct CountedImpl : util::asio::OperationCounter {
+    explicit CountedImpl (boost::asio::io_service& context)
+        : util::asio::OperationCounter(context)
+    {}
+
+    void close (boost::system::error_code& ec) { ec = {}; }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+    asyncNoop (CompletionToken&& token) {
+        util::asio::AsyncCompletion<
+            CompletionToken, void(boost::system::error_code)
+        > init { std::forward<CompletionToken>(token) };
+
+        context().post([handler = std::move(init.handler)]() mutable {
+            handler(boost::system::error_code{});
+        });
+
+        return init.result.get();
+    }
+
+    template <class CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+    asyncCompleteNow (CompletionToken&& token) {
+        // Complete the operation from inside the initiating function.
+        util::asio::AsyncCompletion<
+            CompletionToken, void(boost::system::error_code)
+        > init { std::forward<CompletionToken>(token) };
+
+        init.handler(boost::system::error_code{});
+
+        return init.result.get();
+    }
+};
+
+struct HookedHandler {
+    // Count allocations made through this handler's allocation hook.
+
+    size_t& allocations;
+    bool& invoked;
+
+    void operator() (boost::system::error_code ec) {
+        CHECK(!ec);
+        invoked = true;
+    }
+
+    friend void* asio_handler_allocate (size_t size, HookedHandler* self) {
+        ++self->allocations;
+        return ::operator new(size);
+    }
+
+    friend void asio_handler_deallocate (void* pointer, size_t, HookedHandler*) {
+        ::operator delete(pointer);
+    }
+};
+
+struct Counted : util::asio::TransparentIoObject<CountedImpl> {
+    explicit Counted (boost::asio::io_service& context)
+        : util::asio::TransparentIoObject<CountedImpl>(context)
+    {}
+
+    std::weak_ptr<CountedImpl> impl () { return this->get_implementation(); }
+
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncNoop)
+    UTIL_ASIO_DECL_ASYNC_METHOD(asyncCompleteNow)
+};
+
+} // anonymous namespace
+
+TEST_CASE("OperationCounter counts outstanding operations") {
+    boost::asio::io_service context;
+    Counted counted{context};
+    auto impl = counted.impl().lock();
+
+    auto completions = 0;
+    auto handler = [&](boost::system::error_code ec) {
+        CHECK(!ec);
+        ++completions;
+    };
+
+    CHECK(impl->outstandingOperations() == 0);
+    counted.asyncNoop(handler);
+    counted.asyncNoop(handler);
+    CHECK(impl->outstandingOperations() == 2);
+
+    context.run();
+    CHECK(completions == 2);
+    CHECK(impl->outstandingOperations() == 0);
+}
+
+TEST_CASE("OperationCounter keeps its implementation alive until operations complete") {
+    boost::asio::io_service context;
+    auto completed = false;
+    std::weak_ptr<CountedImpl> impl;
+    {
+        Counted counted{context};
+        impl = counted.impl();
+        counted.asyncNoop([&](boost::system::error_code) { completed = true; });
+    }
+    CHECK(!impl.expired());
+
+    context.run();
+    CHECK(completed);
+    CHECK(impl.expired());
+}
+
+TEST_CASE("TransparentService completions allocate through the handler's hooks") {
+    boost::asio::io_service context;
+    Counted counted{context};
+    size_t allocations = 0;
+    auto invoked = false;
+
+    SUBCASE("outside the io_service, completion is deferred") {
+        counted.asyncCompleteNow(HookedHandler{allocations, invoked});
+        CHECK(!invoked);
+        CHECK(allocations == 1);
+        context.run();
+        CHECK(invoked);
+    }
+
+    SUBCASE("inside the io_service, completion is immediate") {
+        context.post([&] {
+            counted.asyncCompleteNow(HookedHandler{allocations, invoked});
+            CHECK(invoked);
+        });
+        context.run();
+        CHECK(allocations == 0);
+    }
+}
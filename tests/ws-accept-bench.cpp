@@ -0,0 +1,125 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure the WebSocket accept rate of ws::ShardedAcceptor over loopback, with one shared
+// listening socket and with one SO_REUSEPORT listener per shard. Client loops connect (TCP and
+// WebSocket handshake), close, and reconnect as fast as they can for a fixed time.
+//
+// Usage: ws-accept-bench [shards [client-loops [seconds]]]
+
+#include <util/asio/iothreadpool.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/shardedacceptor.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ws = util::asio::ws;
+using boost::system::error_code;
+
+namespace {
+
+struct ClientLoop : std::enable_shared_from_this<ClientLoop> {
+    ClientLoop (boost::asio::io_service& context, std::string port, std::atomic<bool>& stop,
+            std::atomic<size_t>& connects)
+        : context(context), connector(context), port(port), stop(stop), connects(connects)
+    {}
+
+    void start () {
+        if (stop) { return; }
+        auto mq = std::make_shared<ws::Connector::MessageQueue>(context);
+        auto self = shared_from_this();
+        connector.asyncConnect(*mq, "127.0.0.1", port, [self, mq](error_code ec) {
+            if (!ec) {
+                ++self->connects;
+                mq->close(ec);
+            }
+            self->start();
+        });
+    }
+
+    boost::asio::io_service& context;
+    ws::Connector connector;
+    std::string port;
+    std::atomic<bool>& stop;
+    std::atomic<size_t>& connects;
+};
+
+struct AcceptLoop : std::enable_shared_from_this<AcceptLoop> {
+    explicit AcceptLoop (ws::ShardedAcceptor& acceptor) : acceptor(acceptor) {}
+
+    void start () {
+        auto self = shared_from_this();
+        acceptor.asyncAccept([self](error_code ec, ws::ShardedAcceptor::MessageQueuePtr mq) {
+            if (ec == boost::asio::error::operation_aborted) { return; }
+            if (mq) {
+                mq->get_io_service().post([mq] {
+                    auto ec2 = error_code{};
+                    mq->close(ec2);
+                });
+            }
+            self->start();
+        });
+    }
+
+    ws::ShardedAcceptor& acceptor;
+};
+
+double run (ws::ShardedAcceptor::ListenMode mode, size_t shards, size_t clientLoops,
+        double seconds) {
+    util::asio::IoThreadPool serverPool {shards};
+    util::asio::IoThreadPool clientPool {clientLoops};
+    util::asio::IoThread acceptThread;
+
+    auto acceptor = ws::ShardedAcceptor{acceptThread.context(), serverPool};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0}, mode);
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+    std::make_shared<AcceptLoop>(acceptor)->start();
+
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> connects {0};
+    auto clients = std::vector<std::shared_ptr<ClientLoop>>{};
+    for (size_t i = 0; i < clientLoops; ++i) {
+        clients.push_back(
+            std::make_shared<ClientLoop>(clientPool.context(i), port, stop, connects));
+        clientPool.context(i).post([c = clients.back()] { c->start(); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    auto n = connects.load();
+    stop = true;
+
+    auto ec = error_code{};
+    acceptor.close(ec);
+    for (auto& c : clients) {
+        c->connector.close(ec);
+    }
+    return n / seconds;
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t shards = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+        : util::asio::IoThreadPool::defaultSize();
+    size_t clientLoops = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2 * shards;
+    double seconds = argc > 3 ? std::strtod(argv[3], nullptr) : 3;
+
+    using ListenMode = ws::ShardedAcceptor::ListenMode;
+    std::cout << std::fixed << std::setprecision(0)
+              << shards << " shards, " << clientLoops << " client loops\n"
+              << "shared listener:     "
+              << run(ListenMode::shared, shards, clientLoops, seconds) << " accepts/s\n"
+              << "SO_REUSEPORT:        "
+              << run(ListenMode::reusePort, shards, clientLoops, seconds) << " accepts/s\n";
+    return 0;
+}
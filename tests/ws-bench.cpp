@@ -0,0 +1,305 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// End-to-end benchmark of the ws layer over loopback. Client connections, spread across the
+// shards of one IoThreadPool with one ws::Connector each, send messages which a server, spread
+// across the shards of another pool by ws::ShardedAcceptor, echoes back.
+//
+// With --rate 0, each connection sends its next message as soon as the previous echo arrives.
+// Otherwise each connection sends --rate messages/sec from a timer, whether or not its echoes
+// have come back. Every message carries its send time, so round trip latency is measured the same
+// way in both modes.
+//
+// Reports echoed messages/sec, payload MB/sec in each direction, p50/p99/p999 round trip latency,
+// and allocations per round trip, counted on every thread at both ends.
+//
+// Usage: ws-bench [--connections N] [--size BYTES] [--rate MSGS/SEC] [--messages N]
+//                 [--server-threads N] [--client-threads N]
+
+#include "allocations.hpp"
+
+#include <util/asio/iothread.hpp>
+#include <util/asio/iothreadpool.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/shardedacceptor.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_future.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ws = util::asio::ws;
+namespace po = boost::program_options;
+using boost::system::error_code;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    size_t connections;
+    size_t size;
+    double rate;
+    size_t messages;
+    // Per connection.
+    size_t serverThreads;
+    size_t clientThreads;
+};
+
+struct Server : std::enable_shared_from_this<Server> {
+    // Accept connections and echo every message on each, in order.
+    explicit Server (ws::ShardedAcceptor& acceptor) : acceptor(acceptor) {}
+
+    void start () {
+        auto self = shared_from_this();
+        acceptor.asyncAccept([self](error_code ec, ws::ShardedAcceptor::MessageQueuePtr mq) {
+            if (ec == boost::asio::error::operation_aborted) { return; }
+            if (mq) {
+                {
+                    std::lock_guard<std::mutex> lock {self->mutex};
+                    self->connections.push_back(mq);
+                }
+                mq->get_io_service().post([mq] { echo(mq); });
+            }
+            self->start();
+        });
+    }
+
+    static void echo (ws::ShardedAcceptor::MessageQueuePtr mq) {
+        using MessagePtr = ws::ShardedAcceptor::MessageQueue::MessagePtr;
+        mq->asyncReceiveMessage([mq](error_code ec, MessagePtr msg) {
+            if (ec) { return; }
+            // The message must outlive the send.
+            mq->asyncSend(boost::asio::buffer(msg->get_payload()), [msg](error_code) {});
+            echo(mq);
+        });
+    }
+
+    void close () {
+        std::lock_guard<std::mutex> lock {mutex};
+        for (auto& mq : connections) {
+            mq->get_io_service().post([mq] {
+                auto ec = error_code{};
+                mq->close(ec);
+            });
+        }
+        connections.clear();
+    }
+
+    ws::ShardedAcceptor& acceptor;
+    std::mutex mutex;
+    std::vector<ws::ShardedAcceptor::MessageQueuePtr> connections;
+};
+
+class Client {
+    // One connection's sender and receiver. Runs entirely on its io_service's thread.
+
+public:
+    Client (boost::asio::io_service& context, const Options& options)
+        : mq(context)
+        , mOptions(options)
+        , mTimer(context)
+        , mPayload(options.size, 'x')
+        , mBuffer(options.size)
+    {
+        mLatencies.reserve(options.messages);
+    }
+
+    void start () {
+        // Call on mq's io_service.
+        receive();
+        if (mOptions.rate > 0) {
+            mNextSend = Clock::now();
+            tick();
+        }
+        else {
+            send();
+        }
+    }
+
+    std::future<void> done () { return mDone.get_future(); }
+    std::vector<double>& latencies () { return mLatencies; }
+
+    ws::Connector::MessageQueue mq;
+
+private:
+    void send () {
+        auto now = Clock::now().time_since_epoch().count();
+        std::memcpy(&mPayload[0], &now, sizeof(now));
+        mq.asyncSend(boost::asio::buffer(mPayload), [](error_code) {});
+        ++mSent;
+    }
+
+    void tick () {
+        // Send every message which is due, then sleep until the next one is.
+        auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1 / mOptions.rate));
+        while (mSent < mOptions.messages && mNextSend <= Clock::now()) {
+            send();
+            mNextSend += interval;
+        }
+        if (mSent < mOptions.messages) {
+            mTimer.expires_at(mNextSend);
+            mTimer.async_wait([this](error_code ec) {
+                if (!ec) { tick(); }
+            });
+        }
+    }
+
+    void receive () {
+        mq.asyncReceive(boost::asio::buffer(mBuffer), [this](error_code ec, size_t n) {
+            if (ec || n < sizeof(Clock::rep)) {
+                mDone.set_value();
+                return;
+            }
+            auto sent = Clock::rep{};
+            std::memcpy(&sent, mBuffer.data(), sizeof(sent));
+            auto rtt = Clock::now() - Clock::time_point{Clock::duration{sent}};
+            mLatencies.push_back(std::chrono::duration<double, std::micro>(rtt).count());
+            if (mLatencies.size() == mOptions.messages) {
+                mDone.set_value();
+                return;
+            }
+            if (mOptions.rate <= 0) {
+                send();
+            }
+            receive();
+        });
+    }
+
+    const Options& mOptions;
+    boost::asio::steady_timer mTimer;
+    Clock::time_point mNextSend;
+    size_t mSent = 0;
+    std::string mPayload;
+    std::vector<char> mBuffer;
+    std::vector<double> mLatencies;
+    std::promise<void> mDone;
+};
+
+double percentile (const std::vector<double>& sorted, double p) {
+    // NaN if there are no samples, e.g., if every connection failed before its first echo.
+    if (sorted.empty()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return sorted[size_t(p * (sorted.size() - 1))];
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    auto options = Options{};
+    po::options_description desc{"ws-bench options"};
+    desc.add_options()
+        ("help", "print this help")
+        ("connections", po::value<size_t>(&options.connections)->default_value(1),
+            "client connections")
+        ("size", po::value<size_t>(&options.size)->default_value(64),
+            "message size in bytes, at least 8")
+        ("rate", po::value<double>(&options.rate)->default_value(0),
+            "messages/sec per connection, or 0 to send each message when the last echo arrives")
+        ("messages", po::value<size_t>(&options.messages)->default_value(100000),
+            "messages per connection")
+        ("server-threads", po::value<size_t>(&options.serverThreads)->default_value(1),
+            "server io_service threads")
+        ("client-threads", po::value<size_t>(&options.clientThreads)->default_value(1),
+            "client io_service threads");
+    auto vm = po::variables_map{};
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << '\n';
+        return 0;
+    }
+    if (!options.connections || !options.messages) {
+        // A client with no messages to send would never finish, and no connections would leave
+        // nothing to report.
+        std::cerr << "--connections and --messages must be at least 1\n";
+        return 1;
+    }
+    options.size = std::max(options.size, sizeof(Clock::rep));
+
+    // MessageQueue requires its io_service to be run by one thread, so more threads means more
+    // shards, not more threads per io_service.
+    util::asio::IoThreadPool serverPool {options.serverThreads};
+    util::asio::IoThreadPool clientPool {options.clientThreads};
+    util::asio::IoThread acceptThread;
+
+    auto acceptor = ws::ShardedAcceptor{acceptThread.context(), serverPool};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+    auto server = std::make_shared<Server>(acceptor);
+    server->start();
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto connectors = std::vector<std::unique_ptr<ws::Connector>>{};
+    for (size_t i = 0; i < clientPool.size(); ++i) {
+        connectors.emplace_back(new ws::Connector{clientPool.context(i)});
+    }
+    auto clients = std::vector<std::unique_ptr<Client>>{};
+    for (size_t i = 0; i < options.connections; ++i) {
+        auto shard = i % clientPool.size();
+        clients.emplace_back(new Client{clientPool.context(shard), options});
+        connectors[shard]->asyncConnect(clients.back()->mq, "127.0.0.1", port, use_future).get();
+    }
+
+    auto done = std::vector<std::future<void>>{};
+    auto allocationsBefore = util::test::totalAllocations();
+    auto start = Clock::now();
+    for (auto& c : clients) {
+        done.push_back(c->done());
+        auto client = c.get();
+        client->mq.get_io_service().post([client] { client->start(); });
+    }
+    for (auto& d : done) {
+        d.get();
+    }
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    auto allocations = util::test::totalAllocations() - allocationsBefore;
+
+    auto latencies = std::vector<double>{};
+    for (auto& c : clients) {
+        latencies.insert(latencies.end(), c->latencies().begin(), c->latencies().end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto messages = double(latencies.size());
+
+    std::cout << options.connections << " connections, " << options.size << " byte messages, "
+              << options.serverThreads << " server / " << options.clientThreads
+              << " client threads, "
+              << (options.rate > 0 ? std::to_string(options.rate) + " msgs/s per connection"
+                                   : std::string("closed loop")) << '\n'
+              << std::fixed << std::setprecision(0)
+              << "messages/sec:       " << messages / seconds << '\n'
+              << std::setprecision(2)
+              << "MB/sec each way:    " << messages * options.size / seconds / 1e6 << '\n'
+              << std::setprecision(1)
+              << "round trip p50:     " << percentile(latencies, 0.5) << " us\n"
+              << "round trip p99:     " << percentile(latencies, 0.99) << " us\n"
+              << "round trip p999:    " << percentile(latencies, 0.999) << " us\n"
+              << "allocations/msg:    " << allocations / messages << '\n';
+
+    auto ec = error_code{};
+    for (auto& c : clients) {
+        c->mq.close(ec);
+    }
+    server->close();
+    acceptor.close(ec);
+    for (auto& c : connectors) {
+        c->close(ec);
+    }
+    return 0;
+}
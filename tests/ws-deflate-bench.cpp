@@ -0,0 +1,180 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compare WebSocket transfers with and without permessage-deflate over loopback. The client
+// streams JSON telemetry records to the server through a relay which counts the bytes on the
+// wire. For each configuration, report messages/sec, process CPU time per MB of payload, and
+// wire bytes as a fraction of payload bytes.
+//
+// Usage: ws-deflate-bench [messages]
+
+#include <util/asio/iothread.hpp>
+#include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/deflate.hpp>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/use_future.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ws = util::asio::ws;
+namespace ip = boost::asio::ip;
+using boost::system::error_code;
+
+namespace {
+
+class Relay : public std::enable_shared_from_this<Relay> {
+    // Forward one TCP connection to `target`, counting the bytes sent from client to server.
+
+public:
+    Relay (boost::asio::io_service& context, ip::tcp::endpoint target)
+        : mAcceptor(context, {ip::address_v4::loopback(), 0})
+        , mClient(context)
+        , mServer(context)
+        , mTarget(target)
+    {}
+
+    void start () {
+        auto self = shared_from_this();
+        mAcceptor.async_accept(mClient, [self, this](error_code ec) {
+            if (ec) { return; }
+            mServer.async_connect(mTarget, [self, this](error_code ec) {
+                if (ec) { return; }
+                pump(mClient, mServer, mUpstream, &mBytes);
+                pump(mServer, mClient, mDownstream, nullptr);
+            });
+        });
+    }
+
+    void close () {
+        auto ec = error_code{};
+        mAcceptor.close(ec);
+        mClient.close(ec);
+        mServer.close(ec);
+    }
+
+    ip::tcp::endpoint endpoint () const { return mAcceptor.local_endpoint(); }
+    size_t bytes () const { return mBytes; }
+
+private:
+    using Buffer = std::array<char, 65536>;
+
+    void pump (ip::tcp::socket& from, ip::tcp::socket& to, Buffer& buf,
+            std::atomic<size_t>* count) {
+        auto self = shared_from_this();
+        from.async_read_some(boost::asio::buffer(buf),
+                [self, this, &from, &to, &buf, count](error_code ec, size_t n) {
+            if (ec) { return; }
+            if (count) { *count += n; }
+            boost::asio::async_write(to, boost::asio::buffer(buf, n),
+                    [self, this, &from, &to, &buf, count](error_code ec, size_t) {
+                if (!ec) { pump(from, to, buf, count); }
+            });
+        });
+    }
+
+    ip::tcp::acceptor mAcceptor;
+    ip::tcp::socket mClient;
+    ip::tcp::socket mServer;
+    ip::tcp::endpoint mTarget;
+    Buffer mUpstream;
+    Buffer mDownstream;
+    std::atomic<size_t> mBytes {0};
+};
+
+std::vector<std::string> telemetry (size_t n) {
+    // Records like our robots report: the same keys every time, slowly changing values.
+    auto records = std::vector<std::string>{};
+    for (size_t i = 0; i < n; ++i) {
+        std::ostringstream os;
+        os << "{\"serialId\":\"ZRG" << (i % 8) << "\",\"timestamp\":" << 1480000000000 + i * 10
+           << ",\"accelerometer\":{\"x\":" << (i % 17) * 0.01 << ",\"y\":" << (i % 13) * -0.02
+           << ",\"z\":0.98},\"encoders\":[" << i % 360 << ',' << (i * 2) % 360 << ','
+           << (i * 3) % 360 << "],\"buttons\":{\"a\":false,\"b\":" << (i % 50 ? "false" : "true")
+           << ",\"power\":false},\"battery\":" << 4.1 - (i % 100) * 0.001 << '}';
+        records.push_back(os.str());
+    }
+    return records;
+}
+
+template <class Acceptor, class Connector>
+void run (const char* name, const std::vector<std::string>& records) {
+    util::asio::IoThread serverThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = Acceptor{serverThread.context()};
+    acceptor.listen({ip::address_v4::loopback(), 0});
+    auto relay = std::make_shared<Relay>(serverThread.context(), acceptor.getLocalEndpoint());
+    relay->start();
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = typename Acceptor::MessageQueue{serverThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+    auto connector = Connector{clientThread.context()};
+    auto clientMq = typename Connector::MessageQueue{clientThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", std::to_string(relay->endpoint().port()),
+        use_future).get();
+    accepted.get();
+    auto handshakeBytes = relay->bytes();
+
+    auto payloadBytes = size_t(0);
+    auto cpuStart = std::clock();
+    auto start = std::chrono::steady_clock::now();
+
+    auto received = std::async(std::launch::async, [&] {
+        for (size_t i = 0; i < records.size(); ++i) {
+            serverMq.asyncReceiveMessage(use_future).get();
+        }
+    });
+    for (auto& r : records) {
+        clientMq.asyncSend(boost::asio::buffer(r), [](error_code) {});
+        payloadBytes += r.size();
+    }
+    received.get();
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    auto wireBytes = relay->bytes() - handshakeBytes;
+
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(0) << records.size() / seconds
+              << std::setw(14) << std::setprecision(3) << cpu / (payloadBytes / 1e6)
+              << std::setw(12) << std::setprecision(3) << double(wireBytes) / payloadBytes
+              << '\n';
+
+    auto ec = error_code{};
+    clientMq.close(ec);
+    serverMq.close(ec);
+    acceptor.close(ec);
+    connector.close(ec);
+    serverThread.context().post([relay] { relay->close(); });
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    auto records = telemetry(messages);
+
+    std::cout << std::left << std::setw(12) << "config" << std::right
+              << std::setw(12) << "msgs/s"
+              << std::setw(14) << "cpu s/MB"
+              << std::setw(12) << "wire/payload" << '\n';
+    run<ws::Acceptor, ws::Connector>("plain", records);
+    run<ws::DeflateAcceptor, ws::DeflateConnector>("deflate", records);
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compare ws::Connector and ws::ConnectionPool over loopback, for a client which opens a
+// connection, makes one request, and closes the connection again. Reports percentiles of the
+// time from asyncConnect to the server's reply.
+//
+// Usage: ws-pool-bench [requests [warm-count]]
+
+#include <util/asio/iothread.hpp>
+#include <util/asio/iothreadpool.hpp>
+#include <util/asio/ws/connectionpool.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/shardedacceptor.hpp>
+
+#include <boost/asio/use_future.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ws = util::asio::ws;
+using boost::system::error_code;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct EchoServer : std::enable_shared_from_this<EchoServer> {
+    // Accept connections and echo one message on each.
+    explicit EchoServer (ws::ShardedAcceptor& acceptor) : acceptor(acceptor) {}
+
+    void start () {
+        auto self = shared_from_this();
+        acceptor.asyncAccept([self](error_code ec, ws::ShardedAcceptor::MessageQueuePtr mq) {
+            if (ec == boost::asio::error::operation_aborted) { return; }
+            if (mq) {
+                auto buf = std::make_shared<std::array<char, 1024>>();
+                mq->asyncReceive(boost::asio::buffer(*buf), [mq, buf](error_code ec, size_t n) {
+                    if (ec) { return; }
+                    mq->asyncSend(boost::asio::buffer(*buf, n), [mq, buf](error_code) {});
+                });
+            }
+            self->start();
+        });
+    }
+
+    ws::ShardedAcceptor& acceptor;
+};
+
+double percentile (std::vector<double>& v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[size_t(p * (v.size() - 1))];
+}
+
+void report (const char* name, std::vector<double>& latencies) {
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed
+              << std::setprecision(1)
+              << std::setw(10) << percentile(latencies, 0.5)
+              << std::setw(10) << percentile(latencies, 0.99) << '\n';
+}
+
+template <class MessageQueue>
+void request (MessageQueue& mq) {
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    std::array<char, 1024> buffer;
+    mq.asyncSend(boost::asio::buffer("ping", 4), use_future).get();
+    mq.asyncReceive(boost::asio::buffer(buffer), use_future).get();
+    auto ec = error_code{};
+    mq.close(ec);
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    size_t warmCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2;
+
+    util::asio::IoThreadPool serverPool {1};
+    util::asio::IoThread acceptThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = ws::ShardedAcceptor{acceptThread.context(), serverPool};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+    std::make_shared<EchoServer>(acceptor)->start();
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto latencies = std::vector<double>{};
+    latencies.reserve(requests);
+
+    std::cout << std::left << std::setw(10) << "connector" << std::right
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << '\n';
+
+    auto connector = ws::Connector{clientThread.context()};
+    for (size_t i = 0; i < requests; ++i) {
+        auto start = Clock::now();
+        auto mq = ws::Connector::MessageQueue{clientThread.context()};
+        connector.asyncConnect(mq, "127.0.0.1", port, use_future).get();
+        request(mq);
+        latencies.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    report("fresh", latencies);
+
+    latencies.clear();
+    auto pool = ws::ConnectionPool{clientThread.context(), warmCount};
+    pool.warmUp("127.0.0.1", port);
+    for (size_t i = 0; i < requests; ++i) {
+        auto start = Clock::now();
+        auto mq = pool.asyncConnect("127.0.0.1", port, use_future).get();
+        request(*mq);
+        latencies.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    report("pooled", latencies);
+
+    auto ec = error_code{};
+    pool.close(ec);
+    connector.close(ec);
+    acceptor.close(ec);
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure the per-message cost of ws::MessageQueue's receive path over loopback.
+//
+// ping-pong: the client sends a small message and waits for the server's echo. Reports round trip
+// latency percentiles, which include two trips through each side's receive path.
+//
+// burst: the client sends a burst of messages and waits until the server has drained them. Most
+// messages are already queued when the server calls asyncReceive, so this shows the cost of
+// completing a queued message.
+//
+// Both run with websocketpp's default (locking) configs and with the single-threaded configs
+// from singlethreaded.hpp.
+//
+// Usage: ws-receive-bench [messages]
+
+#include <util/asio/iothread.hpp>
+#include <util/asio/ws/acceptor.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/singlethreaded.hpp>
+
+#include <boost/asio/use_future.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ws = util::asio::ws;
+using boost::system::error_code;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+template <class MessageQueue>
+struct Echo {
+    // Receive messages and send each one back, until an error.
+    MessageQueue& mq;
+    std::array<char, 1024> buffer;
+
+    void start () {
+        mq.asyncReceive(boost::asio::buffer(buffer), [this](error_code ec, size_t n) {
+            if (ec) { return; }
+            mq.asyncSend(boost::asio::buffer(buffer, n), [this](error_code ec) {
+                if (!ec) { start(); }
+            });
+        });
+    }
+};
+
+template <class MessageQueue>
+struct Drain {
+    // Receive `count` messages, then fulfill `done`.
+    MessageQueue& mq;
+    size_t count;
+    std::promise<void> done;
+    std::array<char, 1024> buffer;
+
+    void start () {
+        mq.asyncReceive(boost::asio::buffer(buffer), [this](error_code ec, size_t) {
+            if (ec || !--count) {
+                done.set_value();
+                return;
+            }
+            start();
+        });
+    }
+};
+
+double percentile (std::vector<double>& v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[size_t(p * (v.size() - 1))];
+}
+
+template <class Acceptor, class Connector>
+void run (const char* name, size_t messages) {
+    std::cout << name << ":\n";
+
+    util::asio::IoThread serverThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = Acceptor{serverThread.context()};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto serverMq = typename Acceptor::MessageQueue{serverThread.context()};
+    auto accepted = acceptor.asyncAccept(serverMq, use_future);
+
+    auto connector = Connector{clientThread.context()};
+    auto clientMq = typename Connector::MessageQueue{clientThread.context()};
+    connector.asyncConnect(clientMq, "127.0.0.1", port, use_future).get();
+    accepted.get();
+
+    auto payload = std::string(64, 'x');
+    std::array<char, 1024> buffer;
+
+    // ping-pong
+    Echo<typename Acceptor::MessageQueue> echo {serverMq, {}};
+    {
+        serverThread.context().post([&] { echo.start(); });
+
+        auto latencies = std::vector<double>{};
+        latencies.reserve(messages);
+        for (size_t i = 0; i < messages; ++i) {
+            auto start = Clock::now();
+            clientMq.asyncSend(boost::asio::buffer(payload), use_future).get();
+            clientMq.asyncReceive(boost::asio::buffer(buffer), use_future).get();
+            latencies.push_back(
+                std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        }
+        std::cout << std::fixed << std::setprecision(1)
+                  << "  ping-pong: " << messages << " round trips, p50 "
+                  << percentile(latencies, 0.5) << " us, p99 "
+                  << percentile(latencies, 0.99) << " us\n";
+    }
+
+    // burst
+    {
+        // Reconnect so the echo loop above is not also receiving.
+        auto ec = error_code{};
+        clientMq.close(ec);
+        serverMq.close(ec);
+
+        auto serverMq2 = typename Acceptor::MessageQueue{serverThread.context()};
+        auto accepted2 = acceptor.asyncAccept(serverMq2, use_future);
+        auto clientMq2 = typename Connector::MessageQueue{clientThread.context()};
+        connector.asyncConnect(clientMq2, "127.0.0.1", port, use_future).get();
+        accepted2.get();
+
+        clientMq2.setSendBufferLimit(0);
+        for (size_t i = 1; i < messages; ++i) {
+            clientMq2.asyncSend(boost::asio::buffer(payload), [](error_code) {});
+        }
+        clientMq2.asyncSend(boost::asio::buffer(payload), use_future).get();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // Give the server time to read and queue the burst.
+        Drain<typename Acceptor::MessageQueue> drain {serverMq2, messages, {}, {}};
+        auto done = drain.done.get_future();
+        auto start = Clock::now();
+        serverThread.context().post([&] { drain.start(); });
+        done.get();
+        auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(0)
+                  << "  burst: " << messages << " messages, "
+                  << elapsed / messages << " ns per message\n";
+
+        clientMq2.close(ec);
+        serverMq2.close(ec);
+    }
+
+    auto ec = error_code{};
+    acceptor.close(ec);
+    connector.close(ec);
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    run<ws::Acceptor, ws::Connector>("default configs", messages);
+    run<ws::SingleThreadedAcceptor, ws::SingleThreadedConnector>("single-threaded configs",
+        messages);
+    return 0;
+}
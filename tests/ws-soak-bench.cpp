@@ -0,0 +1,235 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure the memory footprint of many mostly idle WebSocket connections over loopback. Opens
+// the connections with Connector::asyncConnectMany, then keeps them open for a while: most sit
+// idle, and a fraction send a small message every 100 ms, which the server echoes. Reports, per
+// connection, the growth in resident set size and the number of allocations made while opening
+// the connections, RSS growth during the soak, and what RSS is left after closing them all. Both
+// ends run in this process, so every figure covers one client and one server connection.
+//
+// The process's file descriptor limit is raised as far as it will go, and the connection count
+// is capped to fit under it.
+//
+// Usage: ws-soak-bench [connections [active-fraction [seconds]]]
+
+#include "allocations.hpp"
+
+#include <util/asio/iothread.hpp>
+#include <util/asio/iothreadpool.hpp>
+#include <util/asio/ws/connector.hpp>
+#include <util/asio/ws/shardedacceptor.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_future.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace ws = util::asio::ws;
+using boost::system::error_code;
+
+namespace {
+
+size_t residentBytes () {
+    // Zero if /proc is unavailable.
+    std::ifstream statm {"/proc/self/statm"};
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+size_t raiseDescriptorLimit () {
+    auto limit = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit)) {
+        return 1024;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    (void)setrlimit(RLIMIT_NOFILE, &limit);
+    (void)getrlimit(RLIMIT_NOFILE, &limit);
+    return limit.rlim_cur;
+}
+
+struct Server : std::enable_shared_from_this<Server> {
+    // Accept connections and echo every message on each.
+    explicit Server (ws::ShardedAcceptor& acceptor) : acceptor(acceptor) {}
+
+    void start () {
+        auto self = shared_from_this();
+        acceptor.asyncAccept([self](error_code ec, ws::ShardedAcceptor::MessageQueuePtr mq) {
+            if (ec == boost::asio::error::operation_aborted) { return; }
+            if (mq) {
+                {
+                    std::lock_guard<std::mutex> lock {self->mutex};
+                    self->connections.push_back(mq);
+                }
+                ++self->accepted;
+                mq->get_io_service().post([mq] { echo(mq); });
+            }
+            self->start();
+        });
+    }
+
+    static void echo (ws::ShardedAcceptor::MessageQueuePtr mq) {
+        using MessagePtr = ws::ShardedAcceptor::MessageQueue::MessagePtr;
+        mq->asyncReceiveMessage([mq](error_code ec, MessagePtr msg) {
+            if (ec) { return; }
+            mq->asyncSend(boost::asio::buffer(msg->get_payload()), [msg](error_code) {});
+            echo(mq);
+        });
+    }
+
+    void close () {
+        std::lock_guard<std::mutex> lock {mutex};
+        for (auto& mq : connections) {
+            mq->get_io_service().post([mq] {
+                auto ec = error_code{};
+                mq->close(ec);
+            });
+        }
+        connections.clear();
+    }
+
+    ws::ShardedAcceptor& acceptor;
+    std::atomic<size_t> accepted {0};
+    std::mutex mutex;
+    std::vector<ws::ShardedAcceptor::MessageQueuePtr> connections;
+};
+
+struct Traffic {
+    // Every 100 ms, send a message on each active connection. Echoes are received and dropped.
+    Traffic (boost::asio::io_service& context, std::vector<ws::Connector::MessageQueuePtr> active)
+        : timer(context), active(std::move(active))
+    {}
+
+    void start () {
+        for (auto& mq : active) {
+            drain(mq);
+        }
+        tick();
+    }
+
+    static void drain (ws::Connector::MessageQueuePtr mq) {
+        using MessagePtr = ws::Connector::MessageQueue::MessagePtr;
+        mq->asyncReceiveMessage([mq](error_code ec, MessagePtr) {
+            if (!ec) { drain(mq); }
+        });
+    }
+
+    void tick () {
+        for (auto& mq : active) {
+            mq->asyncSend(boost::asio::buffer("ping", 4), [](error_code) {});
+            ++sent;
+        }
+        timer.expires_from_now(std::chrono::milliseconds(100));
+        timer.async_wait([this](error_code ec) {
+            if (!ec) { tick(); }
+        });
+    }
+
+    boost::asio::steady_timer timer;
+    std::vector<ws::Connector::MessageQueuePtr> active;
+    std::atomic<size_t> sent {0};
+};
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    size_t connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+    double activeFraction = argc > 2 ? std::strtod(argv[2], nullptr) : 0.1;
+    double seconds = argc > 3 ? std::strtod(argv[3], nullptr) : 10;
+
+    // Two descriptors per connection, plus some slack for everything else.
+    auto descriptors = raiseDescriptorLimit();
+    auto maxConnections = descriptors > 128 ? (descriptors - 128) / 2 : 0;
+    if (connections > maxConnections) {
+        std::cout << "File descriptor limit " << descriptors << " allows only "
+                  << maxConnections << " connections\n";
+        connections = maxConnections;
+    }
+    if (!connections) {
+        return 1;
+    }
+
+    util::asio::IoThreadPool serverPool {1};
+    util::asio::IoThread acceptThread;
+    util::asio::IoThread clientThread;
+
+    auto acceptor = ws::ShardedAcceptor{acceptThread.context(), serverPool};
+    acceptor.listen({boost::asio::ip::address_v4::loopback(), 0});
+    auto port = std::to_string(acceptor.getLocalEndpoint().port());
+    auto server = std::make_shared<Server>(acceptor);
+    server->start();
+    auto connector = ws::Connector{clientThread.context()};
+
+    auto use_future = boost::asio::use_future_t<std::allocator<char>>{};
+    auto targets = std::vector<ws::ConnectTarget>(connections, {"127.0.0.1", port});
+
+    auto rssBefore = residentBytes();
+    auto allocationsBefore = util::test::totalAllocations();
+    auto results = connector.asyncConnectMany(targets, 64, use_future).get();
+    auto clients = std::vector<ws::Connector::MessageQueuePtr>{};
+    for (auto& result : results) {
+        if (result.mq) {
+            clients.push_back(result.mq);
+        }
+    }
+    results.clear();
+    while (server->accepted < clients.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto allocations = util::test::totalAllocations() - allocationsBefore;
+    auto rssOpen = residentBytes();
+    auto n = double(clients.size());
+
+    auto activeCount = size_t(activeFraction * clients.size());
+    Traffic traffic {clientThread.context(), {clients.begin(), clients.begin() + activeCount}};
+    clientThread.context().post([&] { traffic.start(); });
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    clientThread.context().post([&] {
+        traffic.timer.cancel();
+        traffic.active.clear();
+    });
+    auto rssSoak = residentBytes();
+
+    auto ec = error_code{};
+    for (auto& mq : clients) {
+        mq->close(ec);
+    }
+    clients.clear();
+    server->close();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    // Give the close handshakes time to finish.
+    auto rssClosed = residentBytes();
+
+    std::cout << std::fixed << std::setprecision(0)
+              << n << " connections, " << activeCount << " active, "
+              << traffic.sent << " messages sent\n"
+              << "RSS per connection:          " << (double(rssOpen) - rssBefore) / n << " bytes\n"
+              << std::setprecision(1)
+              << "allocations per connection:  " << allocations / n << '\n'
+              << std::setprecision(0)
+              << "RSS growth during soak:      " << (double(rssSoak) - rssOpen) / n
+              << " bytes per connection\n"
+              << "RSS left after closing:      " << (double(rssClosed) - rssBefore) / n
+              << " bytes per connection\n";
+
+    acceptor.close(ec);
+    connector.close(ec);
+    return 0;
+}
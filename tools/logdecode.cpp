@@ -0,0 +1,47 @@
+// Copyright (c) 2016 Barobo, Inc.
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Render a log file written by --log-binary-file as text, in the same format as the text sinks.
+//
+// Usage: cxx-util-logdecode [file...]
+// With no files, read standard input.
+
+#include <util/binarylog.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+void decode (std::istream& in) {
+    auto decoder = util::log::binary::Decoder{in};
+    while (decoder.next(std::cout)) {}
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+    try {
+        if (argc < 2) {
+            decode(std::cin);
+        }
+        for (auto i = 1; i < argc; ++i) {
+            std::ifstream in {argv[i], std::ios::binary};
+            if (!in) {
+                std::cerr << argv[0] << ": could not open " << argv[i] << '\n';
+                return 1;
+            }
+            decode(in);
+        }
+    }
+    catch (std::exception& e) {
+        std::cout.flush();
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}